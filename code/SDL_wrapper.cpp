@@ -4,6 +4,16 @@
 #include <string.h> //strerror
 #include <errno.h> //errno
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/mman.h> //mmap
+#include <sys/stat.h> //fstat
+#include <fcntl.h> //open
+#include <unistd.h> //close
+#endif
+
 // assumptions
 static_assert(SEEK_SET == RW_SEEK_SET);
 static_assert(SEEK_CUR == RW_SEEK_CUR);
@@ -14,7 +24,6 @@ static_assert(SEEK_END == RW_SEEK_END);
 //by all means, my system is not BETTER, just more integrated (ex: I can print a stacktrace on serr)
 //and when you open SDL_RWFromFile, it will insert the path of the file in the error.
 //and I am uncertain if SDL errors are thread safe...
-//TODO: create a SDL_RWFromMem replacement because SDL will not print errors for it (eg: read too much, write too much), and I can also use the stream_info to make better errors.
 
 class RWops_Stdio_NoClose : public RWops
 {
@@ -82,93 +91,397 @@ public:
     }
 };
 
-//this is how I implement the buffer API because I am too lazy to copy paste the code.
-//not high performance by any means, but portable.
-class RWops_SDL_NoClose : public RWops
+bool RWops::eof()
+{
+    long old_tell = tell();
+    if(seek(0, SEEK_END) != 0)
+    {
+        return false;
+    }
+    long new_tell = tell();
+    if(old_tell != new_tell && seek(old_tell, SEEK_SET) != 0)
+    {
+        return false;
+    }
+    return (old_tell == new_tell);
+}
+
+//a read only view of a mapped file.
+class RWops_Mapped : public RWops
 {
 public:
-    SDL_RWops* sdl_ops;
-    RWops_SDL_NoClose(SDL_RWops* stream, const char* file)
-    : sdl_ops(stream)
+    const char* memory;
+    size_t memory_size;
+    size_t position = 0;
+#ifdef _WIN32
+    HANDLE map_handle = NULL;
+#endif
+    RWops_Mapped(const char* mapped, size_t mapped_size, const char* file)
+    : memory(mapped)
+    , memory_size(mapped_size)
     {
         ASSERT(file != NULL);
-        ASSERT(stream != NULL);
+        ASSERT(mapped != NULL || mapped_size == 0);
         stream_info = file;
     }
 
 	size_t read(void *ptr, size_t size, size_t nmemb) override
     {
-        SDL_ClearError();   //must be done because SDL will never clear for you.
-        size_t bytes_read = SDL_RWread(sdl_ops, ptr, size, nmemb);
-        //(new SDL2 feature): SDL_GetErrorMsg is better because it fixes a dangerous race condition to a safe race condition,
-        //but still gives the wrong result without a mutex, so just stick to one thread, ok?
-        //char buffer[1024];
-        //const char* error = SDL_GetErrorMsg(buffer, sizeof(buffer));
-        //char buffer[1024];
-        const char* error = SDL_GetError();//SDL_GetErrorMsg(buffer, sizeof(buffer));
-        //SDL spec says that to check for non eof error you must compare GetError with an empty string to detect errors.
-        if(bytes_read != size && error[0] != '\0')
+        if(size == 0)
         {
-            //errno is not set by fread, if I really wanted to I could use open() and read(), but that is too painful.
-            serrf("Error reading from datastream: `%s`, reason: %s (return: %d)\n", stream_info, error, static_cast<int>(bytes_read));
+            return 0;
         }
-        return bytes_read;
+        //eof isn't an error.
+        size_t available = (memory_size - position) / size;
+        size_t count = (nmemb < available ? nmemb : available);
+        if(count != 0)
+        {
+            memcpy(ptr, memory + position, count * size);
+            position += count * size;
+        }
+        return count;
     }
 	size_t write(const void *ptr, size_t size, size_t nmemb) override
     {
-        SDL_ClearError();   //must be done because SDL will never clear for you.
-        size_t bytes_written = SDL_RWwrite(sdl_ops, ptr, size, nmemb);
-        //char buffer[1024];
-        const char* error = SDL_GetError();//SDL_GetErrorMsg(buffer, sizeof(buffer));
-        if(bytes_written != size && error[0] != '\0')
+        (void)ptr;
+        (void)size;
+        (void)nmemb;
+        serrf("Error writing to datastream: `%s`, reason: mapped files are read only\n", stream_info);
+        return 0;
+    }
+	int seek(long offset, int whence) override
+    {
+        long base;
+        switch(whence)
         {
-            
-            serrf("Error writing to datastream: `%s`, reason: %s (return: %d)\n", stream_info, error, static_cast<int>(bytes_written));
+        case SEEK_SET: base = 0; break;
+        case SEEK_CUR: base = static_cast<long>(position); break;
+        case SEEK_END: base = static_cast<long>(memory_size); break;
+        default:
+            serrf("Error seeking in datastream: `%s`, reason: invalid whence (whence: %d)\n", stream_info, whence);
+            return -1;
         }
-        return bytes_written;
+        //the mapping can't grow, so seeking past the end is an error.
+        if(offset < -base || offset > static_cast<long>(memory_size) - base)
+        {
+            serrf("Error seeking in datastream: `%s`, reason: out of bounds (offset: %ld, whence: %d, size: %zu)\n",
+                  stream_info, offset, whence, memory_size);
+            return -1;
+        }
+        position = static_cast<size_t>(base + offset);
+        return 0;
+    }
+	long tell() override
+    {
+        return static_cast<long>(position);
+    }
+    const char* data() override
+    {
+        return memory;
+    }
+    size_t size() override
+    {
+        return memory_size;
+    }
+    bool eof() override
+    {
+        return position == memory_size;
+    }
+	~RWops_Mapped() override
+    {
+        if(memory_size == 0)
+        {
+            return;
+        }
+#ifdef _WIN32
+        if(UnmapViewOfFile(memory) == 0)
+        {
+            serrf("Failed to unmap: `%s`, reason: %s\n", stream_info, WIN_GetFormattedGLE().c_str());
+        }
+        if(CloseHandle(map_handle) == 0)
+        {
+            serrf("Failed to close: `%s`, reason: %s\n", stream_info, WIN_GetFormattedGLE().c_str());
+        }
+#else
+        if(munmap(const_cast<char*>(memory), memory_size) != 0)
+        {
+            serrf("Failed to unmap: `%s`, reason: %s\n", stream_info, strerror(errno));
+        }
+#endif
+    }
+};
+
+//position = buffer_start + buffer_pos, the source is at buffer_start + buffer_length.
+class RWops_Buffered_NoClose : public RWops
+{
+public:
+    RWops* source;
+    std::unique_ptr<char[]> buffer;
+    size_t buffer_capacity;
+    size_t buffer_pos = 0;
+    size_t buffer_length = 0;
+    long buffer_start;
+    long file_size;
+    RWops_Buffered_NoClose(RWops* stream, size_t capacity, long start, long size)
+    : source(stream)
+    , buffer(new char[capacity])
+    , buffer_capacity(capacity)
+    , buffer_start(start)
+    , file_size(size)
+    {
+        ASSERT(stream != NULL);
+        ASSERT(capacity > 0);
+        stream_info = stream->stream_info;
+    }
+
+	size_t read(void *ptr, size_t size, size_t nmemb) override
+    {
+        if(size == 0)
+        {
+            return 0;
+        }
+        char* out = static_cast<char*>(ptr);
+        size_t wanted = size * nmemb;
+        size_t copied = 0;
+        while(copied < wanted)
+        {
+            if(buffer_pos == buffer_length)
+            {
+                buffer_start += static_cast<long>(buffer_length);
+                buffer_pos = 0;
+                buffer_length = 0;
+                size_t remaining = wanted - copied;
+                if(remaining >= buffer_capacity)
+                {
+                    //too big for the buffer, read it directly.
+                    size_t got = source->read(out + copied, 1, remaining);
+                    buffer_start += static_cast<long>(got);
+                    copied += got;
+                    break;
+                }
+                buffer_length = source->read(buffer.get(), 1, buffer_capacity);
+                if(buffer_length == 0)
+                {
+                    //eof or an error (in serr).
+                    break;
+                }
+            }
+            size_t chunk = buffer_length - buffer_pos;
+            if(chunk > wanted - copied)
+            {
+                chunk = wanted - copied;
+            }
+            memcpy(out + copied, buffer.get() + buffer_pos, chunk);
+            buffer_pos += chunk;
+            copied += chunk;
+        }
+        return copied / size;
+    }
+	size_t write(const void *ptr, size_t size, size_t nmemb) override
+    {
+        (void)ptr;
+        (void)size;
+        (void)nmemb;
+        serrf("Error writing to datastream: `%s`, reason: buffered streams are read only\n", stream_info);
+        return 0;
     }
 	int seek(long offset, int whence) override
     {
-        int out = SDL_RWseek(sdl_ops, offset, whence);
-        if(out < 0)
+        long target;
+        switch(whence)
         {
-            //char buffer[1024];
-            const char* error = SDL_GetError();//SDL_GetErrorMsg(buffer, sizeof(buffer));
-            serrf("Error seeking in datastream: `%s`, reason: %s (return: %d)\n", stream_info, error, out);
+        case SEEK_SET: target = offset; break;
+        case SEEK_CUR: target = tell() + offset; break;
+        case SEEK_END: target = file_size + offset; break;
+        default:
+            serrf("Error seeking in datastream: `%s`, reason: invalid whence (whence: %d)\n", stream_info, whence);
             return -1;
         }
-        //SDL returns tell(), but stdio uses zero as an error check.
+        //short seeks (like stb skipping chunks) stay in the buffer.
+        if(target >= buffer_start && target <= buffer_start + static_cast<long>(buffer_length))
+        {
+            buffer_pos = static_cast<size_t>(target - buffer_start);
+            return 0;
+        }
+        int out = source->seek(target, SEEK_SET);
+        if(out != 0)
+        {
+            return out;
+        }
+        buffer_start = target;
+        buffer_pos = 0;
+        buffer_length = 0;
         return 0;
     }
 	long tell() override
     {
-        int out = SDL_RWtell(sdl_ops);
-        if(out < 0)
+        return buffer_start + static_cast<long>(buffer_pos);
+    }
+    const char* data() override
+    {
+        return source->data();
+    }
+    size_t size() override
+    {
+        return source->size();
+    }
+    bool eof() override
+    {
+        return tell() >= file_size;
+    }
+	~RWops_Buffered_NoClose() override
+    {
+        //give the unread part back.
+        if(buffer_pos != buffer_length)
         {
-            //char buffer[1024];
-            const char* error = SDL_GetError();//SDL_GetErrorMsg(buffer, sizeof(buffer));
-            serrf("Error calling tell in datastream: `%s`, reason: %s (return: %d)\n", stream_info, error, out);
+            (void)source->seek(tell(), SEEK_SET);
         }
-        return out;
     }
-	~RWops_SDL_NoClose() override = default;
 };
 
-class RWops_SDL_AutoClose : public RWops_SDL_NoClose
+class RWops_Buffered_AutoClose : public RWops_Buffered_NoClose
 {
 public:
-    RWops_SDL_AutoClose(SDL_RWops* stream, const char* file) : RWops_SDL_NoClose(stream, file)
+    RWops_Buffered_AutoClose(RWops* stream, size_t capacity, long start, long size)
+    : RWops_Buffered_NoClose(stream, capacity, start, size)
     {
     }
-    ~RWops_SDL_AutoClose() override
+    ~RWops_Buffered_AutoClose() override
     {
-        int out = SDL_RWclose(sdl_ops);
-        if(out != 0){
-            //char buffer[1024];
-            const char* error = SDL_GetError();//SDL_GetErrorMsg(buffer, sizeof(buffer));
-            serrf("Failed to close: `%s`, reason: %s (return: %d)\n", stream_info, error, out);
+        //no need to seek back.
+        buffer_pos = buffer_length;
+        delete source;
+    }
+};
+
+//memory that is either fixed (someone else's memory), or growable (starts in the arena, then moves to the heap).
+class RWops_Memory : public RWops
+{
+public:
+    char* memory;
+    size_t memory_size;
+    size_t capacity;
+    size_t position = 0;
+    bool readonly;
+    bool growable;
+    std::unique_ptr<char[]> heap;
+    RWops_Memory(char* buffer, size_t size, size_t buffer_capacity, bool is_readonly, bool is_growable, const char* name)
+    : memory(buffer)
+    , memory_size(size)
+    , capacity(buffer_capacity)
+    , readonly(is_readonly)
+    , growable(is_growable)
+    {
+        ASSERT(name != NULL);
+        ASSERT(buffer != NULL || buffer_capacity == 0);
+        ASSERT(size <= buffer_capacity);
+        stream_info = name;
+    }
+
+	size_t read(void *ptr, size_t size, size_t nmemb) override
+    {
+        if(size == 0)
+        {
+            return 0;
         }
+        //eof isn't an error.
+        size_t available = (memory_size - position) / size;
+        size_t count = (nmemb < available ? nmemb : available);
+        if(count != 0)
+        {
+            memcpy(ptr, memory + position, count * size);
+            position += count * size;
+        }
+        return count;
+    }
+	size_t write(const void *ptr, size_t size, size_t nmemb) override
+    {
+        if(readonly)
+        {
+            serrf("Error writing to datastream: `%s`, reason: read only memory\n", stream_info);
+            return 0;
+        }
+        if(size == 0)
+        {
+            return 0;
+        }
+        size_t count = nmemb;
+        if(position + size * nmemb > capacity)
+        {
+            if(growable)
+            {
+                //doubling, so many small writes are cheap.
+                size_t new_capacity = (capacity < 256 ? 256 : capacity * 2);
+                if(new_capacity < position + size * nmemb)
+                {
+                    new_capacity = position + size * nmemb;
+                }
+                std::unique_ptr<char[]> new_heap(new char[new_capacity]);
+                if(memory_size != 0)
+                {
+                    memcpy(new_heap.get(), memory, memory_size);
+                }
+                heap = std::move(new_heap);
+                memory = heap.get();
+                capacity = new_capacity;
+            }
+            else
+            {
+                //write what fits, like stdio on a full disk.
+                count = (capacity - position) / size;
+                serrf("Error writing to datastream: `%s`, reason: out of space (size: %zu, writing: %zu at %zu)\n",
+                      stream_info, capacity, size * nmemb, position);
+            }
+        }
+        if(count != 0)
+        {
+            memcpy(memory + position, ptr, count * size);
+            position += count * size;
+        }
+        if(memory_size < position)
+        {
+            memory_size = position;
+        }
+        return count;
+    }
+	int seek(long offset, int whence) override
+    {
+        long base;
+        switch(whence)
+        {
+        case SEEK_SET: base = 0; break;
+        case SEEK_CUR: base = static_cast<long>(position); break;
+        case SEEK_END: base = static_cast<long>(memory_size); break;
+        default:
+            serrf("Error seeking in datastream: `%s`, reason: invalid whence (whence: %d)\n", stream_info, whence);
+            return -1;
+        }
+        if(offset < -base || offset > static_cast<long>(memory_size) - base)
+        {
+            serrf("Error seeking in datastream: `%s`, reason: out of bounds (offset: %ld, whence: %d, size: %zu)\n",
+                  stream_info, offset, whence, memory_size);
+            return -1;
+        }
+        position = static_cast<size_t>(base + offset);
+        return 0;
+    }
+	long tell() override
+    {
+        return static_cast<long>(position);
+    }
+    const char* data() override
+    {
+        return memory;
+    }
+    size_t size() override
+    {
+        return memory_size;
+    }
+    bool eof() override
+    {
+        return position == memory_size;
     }
+	~RWops_Memory() override = default;
 };
 
 Unique_RWops Unique_RWops_OpenFS(const char* path, const char* mode)
@@ -181,21 +494,157 @@ Unique_RWops Unique_RWops_OpenFS(const char* path, const char* mode)
 	}
     return std::make_unique<RWops_Stdio_AutoClose>(fp, path);
 }
+Unique_RWops Unique_RWops_OpenMapped(const char* path, int advice)
+{
+    ASSERT(path != NULL);
+#ifdef _WIN32
+    //there is no madvise, but the file cache uses the same hints.
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if(advice == RWOPS_MAP_SEQUENTIAL)
+    {
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    }
+    else if(advice == RWOPS_MAP_RANDOM)
+    {
+        flags |= FILE_FLAG_RANDOM_ACCESS;
+    }
+    HANDLE file_handle = CreateFileW(WIN_UTF8ToWide(path, static_cast<int>(strlen(path))).c_str(), GENERIC_READ,
+                                     FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+    if(file_handle == INVALID_HANDLE_VALUE)
+    {
+        serrf("Failed to open: `%s`, reason: %s\n", path, WIN_GetFormattedGLE().c_str());
+        return Unique_RWops();
+    }
+    LARGE_INTEGER file_size;
+    if(GetFileSizeEx(file_handle, &file_size) == 0)
+    {
+        serrf("Failed to get the size of: `%s`, reason: %s\n", path, WIN_GetFormattedGLE().c_str());
+        CloseHandle(file_handle);
+        return Unique_RWops();
+    }
+    if(file_size.QuadPart == 0)
+    {
+        //an empty file can't be mapped.
+        CloseHandle(file_handle);
+        return std::make_unique<RWops_Mapped>(nullptr, 0, path);
+    }
+    //the mapping keeps the file open.
+    HANDLE map_handle = CreateFileMappingW(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file_handle);
+    if(map_handle == NULL)
+    {
+        serrf("Failed to map: `%s`, reason: %s\n", path, WIN_GetFormattedGLE().c_str());
+        return Unique_RWops();
+    }
+    const char* memory = static_cast<const char*>(MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0));
+    if(memory == NULL)
+    {
+        serrf("Failed to map: `%s`, reason: %s\n", path, WIN_GetFormattedGLE().c_str());
+        CloseHandle(map_handle);
+        return Unique_RWops();
+    }
+    std::unique_ptr<RWops_Mapped> out = std::make_unique<RWops_Mapped>(memory, static_cast<size_t>(file_size.QuadPart), path);
+    out->map_handle = map_handle;
+    return out;
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        serrf("Failed to open: `%s`, reason: %s\n", path, strerror(errno));
+        return Unique_RWops();
+    }
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0)
+    {
+        serrf("Failed to stat: `%s`, reason: %s\n", path, strerror(errno));
+        close(fd);
+        return Unique_RWops();
+    }
+    size_t file_size = static_cast<size_t>(file_stat.st_size);
+    if(file_size == 0)
+    {
+        //an empty file can't be mapped.
+        close(fd);
+        return std::make_unique<RWops_Mapped>(nullptr, 0, path);
+    }
+    void* memory = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    //the mapping keeps the file open.
+    close(fd);
+    if(memory == MAP_FAILED)
+    {
+        serrf("Failed to map: `%s`, reason: %s\n", path, strerror(errno));
+        return Unique_RWops();
+    }
+    int hint = MADV_NORMAL;
+    if(advice == RWOPS_MAP_SEQUENTIAL)
+    {
+        hint = MADV_SEQUENTIAL;
+    }
+    else if(advice == RWOPS_MAP_RANDOM)
+    {
+        hint = MADV_RANDOM;
+    }
+    //hints aren't required.
+    if(madvise(memory, file_size, hint) != 0)
+    {
+        slogf("warning: madvise failed for `%s`, reason: %s\n", path, strerror(errno));
+    }
+    if(advice == RWOPS_MAP_SEQUENTIAL && madvise(memory, file_size, MADV_WILLNEED) != 0)
+    {
+        slogf("warning: madvise failed for `%s`, reason: %s\n", path, strerror(errno));
+    }
+    return std::make_unique<RWops_Mapped>(static_cast<const char*>(memory), file_size, path);
+#endif
+}
+Unique_RWops Unique_RWops_Buffered(RWops* file, bool autoclose, size_t buffer_size)
+{
+    ASSERT(file != NULL);
+    //the size is cached, so eof() doesn't need to seek.
+    long start = file->tell();
+    long file_size = -1;
+    if(start >= 0 && file->seek(0, SEEK_END) == 0)
+    {
+        file_size = file->tell();
+        if(file->seek(start, SEEK_SET) != 0)
+        {
+            file_size = -1;
+        }
+    }
+    if(start < 0 || file_size < 0)
+    {
+        if(!serr_check_error())
+        {
+            serrf("Failed to buffer: `%s`, reason: the stream can't seek\n", file->stream_info);
+        }
+        if(autoclose)
+        {
+            delete file;
+        }
+        return Unique_RWops();
+    }
+    if(autoclose)
+    {
+        return std::make_unique<RWops_Buffered_AutoClose>(file, buffer_size, start, file_size);
+    }
+    return std::make_unique<RWops_Buffered_NoClose>(file, buffer_size, start, file_size);
+}
 Unique_RWops Unique_RWops_FromFP(FILE* fp, bool autoclose, const char* name)
 {
     return (autoclose ? std::make_unique<RWops_Stdio_AutoClose>(fp, name) : std::make_unique<RWops_Stdio_NoClose>(fp, name));
 }
 Unique_RWops Unique_RWops_FromMemory(char* memory, size_t size, bool readonly, const char* name)
 {
-    SDL_RWops* sdl_rwop = (readonly ? SDL_RWFromConstMem(memory, size) : SDL_RWFromMem(memory, size));
-	if(sdl_rwop == NULL)
-	{
-        //char buffer[1024];
-        const char* error = SDL_GetError();//SDL_GetErrorMsg(buffer, sizeof(buffer));
-		serrf("Failed to open: `%s`, reason: %s\n", name, error);
-		return Unique_RWops();
-	}
-    return std::make_unique<RWops_SDL_AutoClose>(sdl_rwop, name);
+    return std::make_unique<RWops_Memory>(memory, size, size, readonly, false, name);
+}
+Unique_RWops Unique_RWops_FromHeap(std::unique_ptr<char[]> memory, size_t size, const char* name)
+{
+    std::unique_ptr<RWops_Memory> out = std::make_unique<RWops_Memory>(memory.get(), size, size, true, false, name);
+    out->heap = std::move(memory);
+    return out;
+}
+Unique_RWops Unique_RWops_CreateMemory(const char* name, char* arena, size_t arena_size)
+{
+    return std::make_unique<RWops_Memory>(arena, 0, arena_size, false, true, name);
 }
 
 /*
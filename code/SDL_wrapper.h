@@ -11,6 +11,13 @@ public:
 	//unlike SDL_RWops, this will not return tell(), 0 == success.
 	virtual int seek(long offset, int whence) = 0;
 	virtual long tell() = 0;
+	//if the stream is already in memory (mapped files), this is the whole stream from offset 0, otherwise NULL.
+	//the pointer is valid until the RWops is destroyed, use it to skip the copy of read().
+	virtual const char* data() { return NULL; }
+	virtual size_t size() { return 0; }
+	//true if tell() is at the end of the stream.
+	//the default seeks to the end and back, so it's slow unless overridden.
+	virtual bool eof();
 	//the one annoying quirk is that the destructor won't return an error, 
 	//but you should still check serr.
 	//if an error already occured, 
@@ -19,14 +26,31 @@ public:
 
 typedef std::unique_ptr<RWops> Unique_RWops;
 
-enum{
-    
+enum RWOPS_MAP_ADVICE{
+    RWOPS_MAP_NORMAL,
+    //read once from start to end, the OS reads ahead.
+    RWOPS_MAP_SEQUENTIAL,
+    //jumping around (seek indexes), no read ahead.
+    RWOPS_MAP_RANDOM
 };
 
 Unique_RWops Unique_RWops_OpenFS(const char* path, const char* mode);
+//maps the whole file read-only, read() is a memcpy and data() gives the span.
+//the file shouldn't be modified while it is mapped (truncating it would crash the reader).
+Unique_RWops Unique_RWops_OpenMapped(const char* path, int advice = RWOPS_MAP_NORMAL);
+//reads ahead into a buffer, so small reads and short seeks don't reach the file,
+//and the size is cached for eof(). reading only, write() is an error.
+//when a NoClose buffer is destroyed, the file is seeked back to where the reading stopped.
+Unique_RWops Unique_RWops_Buffered(RWops* file, bool autoclose = false, size_t buffer_size = 64 * 1024);
 Unique_RWops Unique_RWops_FromFP(FILE* fp, bool autoclose = false, const char* name = "<unspecified>");
 
-//writing to a FromMemory is janky, because it the size of the file cannot change.
-//if you writing and reading the file, and you don't know the final size of the file, 
-//you must reopen it (size = tell() + file.reset(Unique_RWops_FromMemory)).
+//the size of a FromMemory file cannot change, writing past the end is an error.
+//use Unique_RWops_CreateMemory if you don't know the final size.
 Unique_RWops Unique_RWops_FromMemory(char* memory, size_t size, bool readonly = false, const char* name = "<unspecified>");
+
+//a readonly memory file that owns the memory.
+Unique_RWops Unique_RWops_FromHeap(std::unique_ptr<char[]> memory, size_t size, const char* name = "<unspecified>");
+
+//an empty memory file that grows when written to, data()/size() is the contents.
+//the arena (like a stack buffer) is used until it's full, then the contents move to the heap.
+Unique_RWops Unique_RWops_CreateMemory(const char* name = "<unspecified>", char* arena = NULL, size_t arena_size = 0);
@@ -0,0 +1,247 @@
+#include "global.h"
+
+#include "SDL_wrapper.h"
+#include "mini_tools.h"
+#include "compressed_rwops.h"
+#include "asset_pack.h"
+
+#include <string.h> //memcmp
+
+static_assert(sizeof(asset_pack_header) == 24, "the header is written as is");
+static_assert(sizeof(asset_pack_entry) == 40, "the entries are written as is");
+
+//a compressed entry must save at least this much to be used.
+#define ASSET_PACK_MIN_SAVING 0.9
+
+static std::string normalize_name(const char* name)
+{
+	std::string out(name);
+	std::replace(out.begin(), out.end(), '\\', '/');
+	return out;
+}
+
+bool asset_pack::open(const char* path)
+{
+	ASSERT(path != NULL);
+	file.reset();
+	entries = NULL;
+	names = NULL;
+	entry_count = 0;
+
+	//the lookups jump around.
+	Unique_RWops pack = Unique_RWops_OpenMapped(path, RWOPS_MAP_RANDOM);
+	if(!pack)
+	{
+		return false;
+	}
+	const char* data = pack->data();
+	size_t size = pack->size();
+
+	asset_pack_header header;
+	if(size < sizeof(header))
+	{
+		serrf("asset_pack: `%s` is too small (size: %zu)\n", path, size);
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if(memcmp(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic)) != 0)
+	{
+		serrf("asset_pack: `%s` is not a pack\n", path);
+		return false;
+	}
+	if(header.version != ASSET_PACK_VERSION)
+	{
+		serrf("asset_pack: `%s` version mismatch (expected: %d, got: %u)\n", path, ASSET_PACK_VERSION, header.version);
+		return false;
+	}
+	Uint64 index_size = static_cast<Uint64>(header.entry_count) * sizeof(asset_pack_entry) + header.names_size;
+	if(header.index_offset % alignof(asset_pack_entry) != 0 || header.index_offset > size || index_size > size - header.index_offset)
+	{
+		serrf("asset_pack: `%s` has a broken index (offset: %llu, entries: %u)\n", path,
+			  static_cast<unsigned long long>(header.index_offset), header.entry_count);
+		return false;
+	}
+
+	const asset_pack_entry* pack_entries = reinterpret_cast<const asset_pack_entry*>(data + header.index_offset);
+	const char* pack_names = data + header.index_offset + header.entry_count * sizeof(asset_pack_entry);
+	for(Uint32 i = 0; i < header.entry_count; ++i)
+	{
+		const asset_pack_entry& entry = pack_entries[i];
+		bool bad_name = (static_cast<Uint64>(entry.name_offset) + entry.name_length >= header.names_size ||
+						 pack_names[entry.name_offset + entry.name_length] != '\0');
+		bool bad_data = (entry.offset > size || entry.size > size - entry.offset);
+		bool unsorted = (i != 0 && pack_entries[i - 1].hash > entry.hash);
+		if(bad_name || bad_data || unsorted)
+		{
+			serrf("asset_pack: `%s` has a broken entry (index: %u, name: %d, data: %d, sorted: %d)\n", path, i,
+				  !bad_name, !bad_data, !unsorted);
+			return false;
+		}
+	}
+
+	file = std::move(pack);
+	entries = pack_entries;
+	names = pack_names;
+	entry_count = header.entry_count;
+	return true;
+}
+
+const asset_pack_entry* asset_pack::find(const char* name)
+{
+	ASSERT(file && "open first");
+	std::string key = normalize_name(name);
+	Uint64 hash = fnv1a_hash(key.data(), key.size());
+	const asset_pack_entry* last = entries + entry_count;
+	const asset_pack_entry* it = std::lower_bound(
+		entries, last, hash, [](const asset_pack_entry& entry, Uint64 value) { return entry.hash < value; });
+	//collisions are next to each other.
+	for(; it != last && it->hash == hash; ++it)
+	{
+		if(it->name_length == key.size() && memcmp(names + it->name_offset, key.data(), key.size()) == 0)
+		{
+			return it;
+		}
+	}
+	return NULL;
+}
+
+bool asset_pack::contains(const char* name)
+{
+	return find(name) != NULL;
+}
+
+Unique_RWops asset_pack::open_entry(const char* name)
+{
+	const asset_pack_entry* entry = find(name);
+	if(entry == NULL)
+	{
+		serrf("asset_pack: `%s` is not in `%s`\n", name, file->stream_info);
+		return Unique_RWops();
+	}
+	//the name in the pack outlives the view.
+	Unique_RWops view = Unique_RWops_FromMemory(const_cast<char*>(file->data() + entry->offset), entry->size, true,
+												names + entry->name_offset);
+	if(view && (entry->flags & ASSET_PACK_COMPRESSED) != 0)
+	{
+		//the chunks are read straight from the view.
+		return Unique_RWops_Inflate(view.release(), true);
+	}
+	return view;
+}
+
+//pads the file to the alignment.
+static bool write_padding(RWops* out, size_t align)
+{
+	static const char zeros[ASSET_PACK_ALIGN] = {};
+	size_t position = static_cast<size_t>(out->tell());
+	size_t padding = (align - position % align) % align;
+	return padding == 0 || out->write(zeros, 1, padding) == padding;
+}
+
+bool build_asset_pack(const char* out_path, const std::vector<std::string>& files, bool compress)
+{
+	ASSERT(out_path != NULL);
+	TIMER_U start = timer_now();
+
+	Unique_RWops out = Unique_RWops_OpenFS(out_path, "wb");
+	if(!out)
+	{
+		return false;
+	}
+
+	//the header is written again at the end.
+	asset_pack_header header;
+	memset(&header, 0, sizeof(header));
+	if(out->write(&header, sizeof(header), 1) != 1)
+	{
+		return false;
+	}
+
+	std::vector<asset_pack_entry> pack_entries;
+	std::string pack_names;
+	size_t total_bytes = 0;
+	size_t stored_bytes = 0;
+	for(const std::string& path : files)
+	{
+		std::string name = normalize_name(path.c_str());
+		asset_pack_entry entry;
+		entry.hash = fnv1a_hash(name.data(), name.size());
+		for(const asset_pack_entry& other : pack_entries)
+		{
+			if(other.hash == entry.hash && other.name_length == name.size() &&
+			   memcmp(pack_names.data() + other.name_offset, name.data(), name.size()) == 0)
+			{
+				serrf("asset_pack: `%s` was added twice\n", path.c_str());
+				return false;
+			}
+		}
+
+		Unique_RWops file = Unique_RWops_OpenMapped(path.c_str(), RWOPS_MAP_SEQUENTIAL);
+		if(!file || !write_padding(out.get(), ASSET_PACK_ALIGN))
+		{
+			return false;
+		}
+		entry.offset = static_cast<Uint64>(out->tell());
+		entry.size = file->size();
+		entry.flags = 0;
+		entry.reserved = 0;
+		const char* stored = file->data();
+		Unique_RWops compressed;
+		if(compress && file->size() != 0)
+		{
+			compressed = Unique_RWops_CreateMemory(file->stream_info);
+			if(!deflate_chunks(file->data(), file->size(), compressed.get()))
+			{
+				return false;
+			}
+			if(compressed->size() < file->size() * ASSET_PACK_MIN_SAVING)
+			{
+				stored = compressed->data();
+				entry.size = compressed->size();
+				entry.flags |= ASSET_PACK_COMPRESSED;
+			}
+		}
+		if(entry.size != 0 && out->write(stored, 1, entry.size) != entry.size)
+		{
+			return false;
+		}
+		stored_bytes += entry.size;
+		entry.name_offset = static_cast<Uint32>(pack_names.size());
+		entry.name_length = static_cast<Uint32>(name.size());
+		pack_names += name;
+		pack_names += '\0';
+		pack_entries.push_back(entry);
+		total_bytes += file->size();
+	}
+
+	std::sort(pack_entries.begin(), pack_entries.end(),
+			  [](const asset_pack_entry& lhs, const asset_pack_entry& rhs) { return lhs.hash < rhs.hash; });
+
+	if(!write_padding(out.get(), alignof(asset_pack_entry)))
+	{
+		return false;
+	}
+	memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic));
+	header.version = ASSET_PACK_VERSION;
+	header.entry_count = static_cast<Uint32>(pack_entries.size());
+	header.names_size = static_cast<Uint32>(pack_names.size());
+	header.index_offset = static_cast<Uint64>(out->tell());
+	if((!pack_entries.empty() && out->write(pack_entries.data(), sizeof(asset_pack_entry), pack_entries.size()) != pack_entries.size()) ||
+	   (!pack_names.empty() && out->write(pack_names.data(), 1, pack_names.size()) != pack_names.size()))
+	{
+		return false;
+	}
+	if(out->seek(0, SEEK_SET) != 0 || out->write(&header, sizeof(header), 1) != 1)
+	{
+		return false;
+	}
+	out.reset();
+	if(serr_check_error())
+	{
+		return false;
+	}
+
+	slogf("asset_pack: wrote `%s`, %zu files, %zu KB (stored: %zu KB) in %.2f ms\n", out_path, pack_entries.size(),
+		  total_bytes / 1024, stored_bytes / 1024, timer_delta<TIMER_MS>(start, timer_now()));
+	return true;
+}
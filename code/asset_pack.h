@@ -0,0 +1,74 @@
+#pragma once
+
+//many assets in one file, so loading them doesn't need an open() per file.
+//the pack is mapped, the index is sorted by the hash of the name (binary search),
+//and every entry starts on a page, so the entries are used straight from the mapping.
+//the names use '/' (a '\' is converted), and are the paths that were given to build_asset_pack.
+//compressed entries are deflate_chunks streams (see compressed_rwops.h), they are only used if they are smaller.
+//the numbers are little endian.
+
+#define ASSET_PACK_MAGIC "DPAK"
+#define ASSET_PACK_VERSION 2
+#define ASSET_PACK_ALIGN 4096
+
+enum ASSET_PACK_FLAGS
+{
+	ASSET_PACK_COMPRESSED = 1
+};
+
+struct asset_pack_header
+{
+	char magic[4];
+	Uint32 version;
+	Uint32 entry_count;
+	//the names follow the entries, null terminated.
+	Uint32 names_size;
+	Uint64 index_offset;
+};
+
+struct asset_pack_entry
+{
+	Uint64 hash;
+	Uint64 offset;
+	Uint64 size;
+	Uint32 name_offset;
+	Uint32 name_length;
+	Uint32 flags;
+	Uint32 reserved;
+};
+
+class asset_pack
+{
+public:
+	//maps the pack and checks the index.
+	MYNODISCARD bool open(const char* path);
+
+	//a readonly view of the entry, NULL if it doesn't exist (serr).
+	//the view must be destroyed before the pack.
+	//compressed entries are decompressed while reading, so data() is NULL for them.
+	Unique_RWops open_entry(const char* name);
+
+	bool contains(const char* name);
+
+	size_t get_entry_count() const
+	{
+		return entry_count;
+	}
+
+	explicit operator bool() const
+	{
+		return static_cast<bool>(file);
+	}
+
+private:
+	Unique_RWops file;
+	const asset_pack_entry* entries = NULL;
+	const char* names = NULL;
+	size_t entry_count = 0;
+
+	const asset_pack_entry* find(const char* name);
+};
+
+//writes the files into a pack, the names are the paths.
+//compress tries to compress every file (already compressed files like png/gif usually stay stored).
+MYNODISCARD bool build_asset_pack(const char* out_path, const std::vector<std::string>& files, bool compress = false);
@@ -0,0 +1,134 @@
+#include "global.h"
+
+#include "SDL_wrapper.h"
+#include "cvar.h"
+#include "openal_wrapper.h"
+#include "audio_bench.h"
+
+static cvar& cv_audio_bench_streams = register_cvar_value(
+	"cv_audio_bench_streams", 1, "the number of copies of the file streamed at once in cv_audio_bench", CVAR_STARTUP);
+static cvar& cv_audio_bench_seconds = register_cvar_value(
+	"cv_audio_bench_seconds", 60, "the seconds of audio mixed in cv_audio_bench (the file loops)", CVAR_STARTUP);
+static cvar& cv_audio_bench_step_ms = register_cvar_value(
+	"cv_audio_bench_step_ms", 10, "the audio mixed between each update in cv_audio_bench, like a frame", CVAR_STARTUP);
+static cvar& cv_audio_bench_rate = register_cvar_value(
+	"cv_audio_bench_rate", 48000, "the mixing frequency of cv_audio_bench", CVAR_STARTUP);
+static cvar& cv_audio_bench_io = register_cvar_value(
+	"cv_audio_bench_io", 2, "how cv_audio_bench opens the file, 0 = stdio, 1 = buffered stdio, 2 = mapped", CVAR_STARTUP);
+
+static bool bench_streams(const char* path, int rate)
+{
+	int stream_count = std::max(static_cast<int>(cv_audio_bench_streams.get_value()), 1);
+	double step_ms = std::max(cv_audio_bench_step_ms.get_value(), 1.0);
+	int step_frames = std::max(static_cast<int>(rate * step_ms / 1000.0), 1);
+	long steps = static_cast<long>(cv_audio_bench_seconds.get_value() * 1000.0 / step_ms);
+
+	std::vector<std::unique_ptr<AL_OggStream>> streams;
+	for(int i = 0; i < stream_count; ++i)
+	{
+		Unique_RWops file;
+		switch(static_cast<int>(cv_audio_bench_io.get_value()))
+		{
+		case 0:
+			file = Unique_RWops_OpenFS(path, "rb");
+			break;
+		case 1:
+			file = Unique_RWops_OpenFS(path, "rb");
+			if(file)
+			{
+				file = Unique_RWops_Buffered(file.release(), true);
+			}
+			break;
+		default:
+			file = Unique_RWops_OpenMapped(path, RWOPS_MAP_SEQUENTIAL);
+		}
+		if(!file)
+		{
+			return false;
+		}
+		streams.emplace_back(new AL_OggStream);
+		if(!streams.back()->open(std::move(file), AL_STREAM_LOOPING) || !streams.back()->play())
+		{
+			return false;
+		}
+	}
+
+	std::unique_ptr<float[]> mix(new float[step_frames * 2]);
+	std::vector<TIMER_RESULT> update_times;
+	update_times.reserve(steps * stream_count);
+	TIMER_RESULT update_total_ms = 0;
+	TIMER_RESULT mix_total_ms = 0;
+
+	TIMER_U bench_start = timer_now();
+	for(long step = 0; step < steps; ++step)
+	{
+		//the virtual clock, the buffers are consumed as soon as this is called.
+		TIMER_U mix_start = timer_now();
+		AL_RenderLoopback(mix.get(), step_frames);
+		mix_total_ms += timer_delta<TIMER_MS>(mix_start, timer_now());
+
+		for(auto& stream : streams)
+		{
+			TIMER_U update_start = timer_now();
+			if(!stream->update())
+			{
+				return false;
+			}
+			TIMER_RESULT update_ms = timer_delta<TIMER_MS>(update_start, timer_now());
+			update_times.push_back(update_ms);
+			update_total_ms += update_ms;
+		}
+	}
+	TIMER_RESULT wall_sec = timer_delta<TIMER_SEC>(bench_start, timer_now());
+
+	Uint64 decoded_bytes = 0;
+	Uint32 ring_underruns = 0;
+	Uint32 source_underruns = 0;
+	for(auto& stream : streams)
+	{
+		decoded_bytes += stream->get_telemetry().decoded_bytes;
+		ring_underruns += stream->get_ring_underruns();
+		source_underruns += stream->get_source_underruns();
+		if(!stream->close())
+		{
+			return false;
+		}
+	}
+
+	if(update_times.empty())
+	{
+		slog("audio bench: nothing was mixed\n");
+		return true;
+	}
+
+	std::sort(update_times.begin(), update_times.end());
+	size_t count = update_times.size();
+	double audio_sec = static_cast<double>(steps) * step_frames / rate;
+	double decoded_mb = decoded_bytes / (1024.0 * 1024.0);
+
+	slogf("audio bench: %d streams, %f s of audio in %f s (%fx realtime)\n",
+		  stream_count, audio_sec, wall_sec, (wall_sec > 0 ? audio_sec / wall_sec : 0));
+	slogf("audio bench: decoded MB: %f, MB/s (of update time): %f\n",
+		  decoded_mb, (update_total_ms > 0 ? decoded_mb / (update_total_ms / 1000.0) : 0));
+	slogf("audio bench: update ms: median: %f, 95th: %f, 99th: %f, max: %f\n",
+		  update_times[count / 2], update_times[(count * 95) / 100], update_times[(count * 99) / 100], update_times.back());
+	slogf("audio bench: cpu ms per second of audio: update: %f, mix: %f\n",
+		  update_total_ms / audio_sec, mix_total_ms / audio_sec);
+	//the clock only moves when mixing, so an underrun means a step was bigger than the queue.
+	slogf("audio bench: underruns: ring: %u, source: %u\n", ring_underruns, source_underruns);
+	return true;
+}
+
+bool run_audio_bench(const char* path)
+{
+	ASSERT(path != NULL);
+	int rate = static_cast<int>(cv_audio_bench_rate.get_value());
+	if(!InitAL_Loopback(rate))
+	{
+		return false;
+	}
+	bool success = bench_streams(path, rate);
+	//the streams are closed by now (or the errors are already in serr).
+	CloseAL();
+	return success;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+//cv_audio_bench, streams an ogg through AL_OggStream into a loopback device (no sound card needed),
+//the mixer clock runs as fast as the cpu, so this measures the decode and refill cost (for CI).
+//prints the report into slog, returns false on error.
+MYNODISCARD bool run_audio_bench(const char* path);
@@ -0,0 +1,802 @@
+#include "global.h"
+
+#include "SDL_wrapper.h"
+#include "cvar.h"
+#include "debug_tools.h"
+#include "openal_wrapper.h"
+#include "sound_cache.h"
+#include "audio_engine.h"
+
+static cvar& cv_audio_voices = register_cvar_value(
+	"cv_audio_voices", 32, "the number of sources the audio engine can play at once", CVAR_STARTUP);
+static cvar& cv_audio_workers = register_cvar_value(
+	"cv_audio_workers", 2, "the number of threads decoding the audio streams", CVAR_STARTUP);
+static cvar& cv_audio_stats_ms = register_cvar_value(
+	"cv_audio_stats_ms", 10000, "how often the audio stream stats are printed, 0 = never", CVAR_DEFAULT);
+
+//just in case the buffers are tiny.
+#define AUDIO_ENGINE_MIN_WAIT_MS 1
+//a worker without streams still pulses.
+#define AUDIO_ENGINE_IDLE_MS 100
+
+bool audio_engine::init()
+{
+	ASSERT(sources.empty() && "already initialized");
+
+	if(!create_voices())
+	{
+		return false;
+	}
+
+	stats_time = timer_now();
+	return true;
+}
+
+bool audio_engine::create_voices()
+{
+	int voice_count = std::max(static_cast<int>(cv_audio_voices.get_value()), 1);
+	int buffer_count = AL_OggStream::get_voice_buffer_count();
+
+	//one at a time, because the implementation might have a lower limit.
+	for(int i = 0; i < voice_count; ++i)
+	{
+		ALuint source;
+		alGenSources(1, &source);
+		if(alGetError() != AL_NO_ERROR)
+		{
+			if(sources.empty())
+			{
+				serr("audio_engine: could not create any sources\n");
+				return false;
+			}
+			slogf("warning: audio_engine: only %d of %d sources could be created\n", i, voice_count);
+			break;
+		}
+		sources.push_back(source);
+
+		// this makes the source follow the listener, because stereo is pointless in 3D space
+		alSource3i(source, AL_POSITION, 0, 0, -1);
+		alSourcei(source, AL_SOURCE_RELATIVE, AL_TRUE);
+		alSourcei(source, AL_ROLLOFF_FACTOR, 0);
+		if(!alerr("Could not set source parameters"))
+		{
+			return false;
+		}
+	}
+
+	buffers.resize(sources.size() * buffer_count);
+	alGenBuffers(static_cast<ALsizei>(buffers.size()), buffers.data());
+	if(!alerr("Could not create buffers"))
+	{
+		buffers.clear();
+		return false;
+	}
+
+	//the buffers pointers are stable because the vector won't be resized.
+	voices.resize(sources.size());
+	for(size_t i = 0; i < voices.size(); ++i)
+	{
+		voices[i].source = sources[i];
+		voices[i].buffers = buffers.data() + i * buffer_count;
+		voices[i].buffer_count = buffer_count;
+		free_voices.push_back(static_cast<int>(voices.size() - 1 - i));
+	}
+
+	return true;
+}
+
+bool audio_engine::delete_voices()
+{
+	bool success = true;
+	voices.clear();
+	free_voices.clear();
+
+	if(!sources.empty())
+	{
+		alDeleteSources(static_cast<ALsizei>(sources.size()), sources.data());
+		if(!alerr("Failed to delete sources"))
+		{
+			success = false;
+		}
+		sources.clear();
+	}
+	if(!buffers.empty())
+	{
+		alDeleteBuffers(static_cast<ALsizei>(buffers.size()), buffers.data());
+		if(!alerr("Failed to delete buffers"))
+		{
+			success = false;
+		}
+		buffers.clear();
+	}
+	return success;
+}
+
+void audio_engine::start(bool use_threads)
+{
+#ifndef NO_THREADS
+	ASSERT(workers.empty() && "already started");
+	if(!use_threads)
+	{
+		return;
+	}
+	stop_requested = false;
+	int worker_count = std::max(static_cast<int>(cv_audio_workers.get_value()), 1);
+	for(int i = 0; i < worker_count; ++i)
+	{
+		workers.emplace_back(new worker_state);
+		worker_state* worker = workers.back().get();
+		worker->index = i;
+		worker->thread.run("audio", [this, worker](debug_thread*) { worker_run(worker); });
+	}
+#else
+	(void)use_threads;
+#endif
+}
+
+bool audio_engine::join(int timeout_ms)
+{
+#ifndef NO_THREADS
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		stop_requested = true;
+	}
+	cond.notify_all();
+	for(auto& worker : workers)
+	{
+		if(!worker->thread.timed_join(timeout_ms))
+		{
+			return false;
+		}
+	}
+#else
+	(void)timeout_ms;
+#endif
+	return true;
+}
+
+std::string audio_engine::get_errors()
+{
+	std::string errors;
+#ifndef NO_THREADS
+	for(auto& worker : workers)
+	{
+		errors += worker->thread.get_errors();
+	}
+	workers.clear();
+#endif
+	print_stats();
+	return errors;
+}
+
+bool audio_engine::destroy()
+{
+	bool success = true;
+
+#ifndef NO_THREADS
+	ASSERT(workers.empty() && "join first");
+#endif
+
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		for(auto& entry : streams)
+		{
+			if(!entry->stream.close())
+			{
+				success = false;
+			}
+		}
+		streams.clear();
+	}
+
+	if(!delete_voices())
+	{
+		success = false;
+	}
+
+	return success;
+}
+
+bool audio_engine::switch_device(const char* device_name, sound_cache* sounds)
+{
+	std::lock_guard<std::mutex> lock(mut);
+	//the workers wait on the streams until the switch is done.
+	std::vector<std::unique_lock<std::mutex>> entry_locks;
+	entry_locks.reserve(streams.size());
+	for(auto& entry : streams)
+	{
+		entry_locks.emplace_back(entry->mut);
+	}
+
+	if(AL_CanReopenDevice())
+	{
+		//nothing is lost, the mixer continues on the new device.
+		if(!AL_ReopenDevice(device_name))
+		{
+			return false;
+		}
+		slogf("audio_engine: switched to `%s`\n", (device_name != NULL ? device_name : "default"));
+		return true;
+	}
+
+	slog("audio_engine: ALC_SOFT_reopen_device not supported, recreating the device\n");
+
+	//sounds are short, they are cut instead of restarted.
+	for(auto& entry : streams)
+	{
+		if(entry->sound || entry->finished.load())
+		{
+			release_stream(*entry);
+		}
+		else if(!entry->stream.detach_device())
+		{
+			entry->error = serr_get_error();
+			slogf("audio_engine: `%s` failed:\n%s", entry->path.c_str(), entry->error.c_str());
+			entry->finished = true;
+			//the voice is deleted below anyway, but the ids must be released before the context is.
+			if(!entry->stream.close())
+			{
+				entry->error += serr_get_error();
+			}
+			entry->voice = -1;
+		}
+	}
+
+	if(sounds != NULL)
+	{
+		sounds->release_device();
+	}
+	if(!delete_voices())
+	{
+		//the context is destroyed next.
+		slogf("warning: audio_engine: %s", serr_get_error().c_str());
+	}
+
+	CloseAL();
+	if(!InitAL(device_name))
+	{
+		return false;
+	}
+
+	//the voice indexes are kept, so only the free list needs to be rebuilt.
+	if(!create_voices())
+	{
+		return false;
+	}
+	if(sounds != NULL && !sounds->restore_device())
+	{
+		return false;
+	}
+	std::vector<bool> used(voices.size(), false);
+	for(auto& entry : streams)
+	{
+		if(entry->finished.load() || entry->voice == -1)
+		{
+			continue;
+		}
+		if(static_cast<size_t>(entry->voice) >= voices.size())
+		{
+			//the new device has fewer sources.
+			entry->error = "the new device has no voice for the stream\n";
+			slogf("audio_engine: `%s` stopped: %s", entry->path.c_str(), entry->error.c_str());
+			entry->finished = true;
+			entry->voice = -1;
+			if(!entry->stream.close())
+			{
+				entry->error += serr_get_error();
+			}
+			continue;
+		}
+		used[entry->voice] = true;
+		if(!entry->stream.attach_device(&voices[entry->voice]))
+		{
+			entry->error = serr_get_error();
+			slogf("audio_engine: `%s` failed:\n%s", entry->path.c_str(), entry->error.c_str());
+			entry->finished = true;
+		}
+	}
+	free_voices.clear();
+	for(size_t i = voices.size(); i-- > 0;)
+	{
+		if(!used[i])
+		{
+			free_voices.push_back(static_cast<int>(i));
+		}
+	}
+	//wake the workers up to refill the streams.
+#ifndef NO_THREADS
+	cond.notify_all();
+#endif
+	slogf("audio_engine: switched to `%s`\n", (device_name != NULL ? device_name : "default"));
+	return true;
+}
+
+int audio_engine::play(const char* path, int flags, int priority, float gain)
+{
+	ASSERT(path != NULL);
+	ASSERT(!sources.empty() && "not initialized");
+
+	std::shared_ptr<engine_stream> entry = std::make_shared<engine_stream>();
+	entry->path = path;
+	entry->priority = priority;
+
+	//the file keeps the name pointer, so it must point to the entry's copy.
+	Unique_RWops file = Unique_RWops_OpenMapped(entry->path.c_str(), RWOPS_MAP_SEQUENTIAL);
+	if(!file)
+	{
+		return 0;
+	}
+
+	//opening decodes the first buffers, so the engine mutex is only held to take the voice,
+	//the entry is added first so switch_device() waits for it (it locks every stream).
+	std::unique_lock<std::mutex> entry_lock(entry->mut);
+	int voice;
+	int handle;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		voice = take_voice(path, priority);
+		if(voice == -1)
+		{
+			return 0;
+		}
+		entry->voice = voice;
+		entry->opening = true;
+		handle = add_stream(entry);
+	}
+
+	bool success = entry->stream.open(std::move(file), flags, &voices[voice]);
+	if(success)
+	{
+		alSourcef(voices[voice].source, AL_GAIN, gain);
+		success = alerr("Could not set the gain") && entry->stream.play();
+	}
+	if(success)
+	{
+		entry->opening = false;
+		return handle;
+	}
+
+	//the error is already in serr.
+	(void)entry->stream.close();
+	entry->finished = true;
+	entry_lock.unlock();
+
+	std::lock_guard<std::mutex> lock(mut);
+	entry_lock.lock();
+	//switch_device() could have released the voice already.
+	if(entry->voice != -1)
+	{
+		free_voices.push_back(entry->voice);
+		entry->voice = -1;
+	}
+	entry_lock.unlock();
+	streams.erase(std::find(streams.begin(), streams.end(), entry));
+	return 0;
+}
+
+int audio_engine::play_sound(const sound_ref& sound, int priority, float gain)
+{
+	ASSERT(sound);
+	ASSERT(!sources.empty() && "not initialized");
+
+	std::shared_ptr<engine_stream> entry = std::make_shared<engine_stream>();
+	entry->path = sound->path;
+	entry->priority = priority;
+
+	std::lock_guard<std::mutex> lock(mut);
+
+	int voice = take_voice(sound->path.c_str(), priority);
+	if(voice == -1)
+	{
+		return 0;
+	}
+
+	ALuint source = voices[voice].source;
+	alSourcei(source, AL_LOOPING, AL_FALSE);
+	alSourcei(source, AL_BUFFER, static_cast<ALint>(sound->buffer));
+	alSourcef(source, AL_GAIN, gain);
+	alSourcePlay(source);
+	if(!alerr("Could not play sound"))
+	{
+		alSourceRewind(source);
+		alSourcei(source, AL_BUFFER, 0);
+		free_voices.push_back(voice);
+		return 0;
+	}
+
+	//the cache evicts the least recently played sounds first.
+	sound->touch();
+	entry->sound = sound;
+	entry->voice = voice;
+	return add_stream(entry);
+}
+
+void audio_engine::stop(int handle)
+{
+	std::lock_guard<std::mutex> lock(mut);
+	for(auto it = streams.begin(); it != streams.end(); ++it)
+	{
+		if((*it)->handle == handle)
+		{
+			{
+				std::lock_guard<std::mutex> entry_lock((*it)->mut);
+				release_stream(**it);
+			}
+			streams.erase(it);
+			return;
+		}
+	}
+}
+
+bool audio_engine::is_playing(int handle)
+{
+	std::lock_guard<std::mutex> lock(mut);
+	std::shared_ptr<engine_stream> entry = find_stream(handle);
+	return entry && !entry->finished.load();
+}
+
+std::string audio_engine::get_error(int handle)
+{
+	std::lock_guard<std::mutex> lock(mut);
+	std::shared_ptr<engine_stream> entry = find_stream(handle);
+	if(!entry)
+	{
+		return std::string();
+	}
+	std::lock_guard<std::mutex> entry_lock(entry->mut);
+	return entry->error;
+}
+
+bool audio_engine::update()
+{
+#ifndef NO_THREADS
+	for(auto& worker : workers)
+	{
+		if(worker->thread.exited.load())
+		{
+			//the errors are read after joining.
+			serrf("audio_engine: worker %d quit\n", worker->index);
+			return false;
+		}
+	}
+#endif
+
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		bool inline_update = true;
+#ifndef NO_THREADS
+		inline_update = workers.empty();
+#endif
+		for(auto it = streams.begin(); it != streams.end();)
+		{
+			//erasing shouldn't destroy the locked mutex.
+			std::shared_ptr<engine_stream> keep = *it;
+			engine_stream& entry = *keep;
+			//don't wait for a worker that is decoding this stream, or for play().
+			if(entry.opening.load() || (!inline_update && !entry.finished.load()))
+			{
+				++it;
+				continue;
+			}
+			std::lock_guard<std::mutex> entry_lock(entry.mut);
+			if(inline_update)
+			{
+				update_stream(entry);
+			}
+			if(entry.finished.load())
+			{
+				release_stream(entry);
+				//failed streams are kept until stop() so the error can be read.
+				if(entry.error.empty())
+				{
+					it = streams.erase(it);
+					continue;
+				}
+			}
+			++it;
+		}
+	}
+
+	if(cv_audio_stats_ms.get_value() > 0 &&
+	   timer_delta<TIMER_MS>(stats_time, timer_now()) >= cv_audio_stats_ms.get_value())
+	{
+		print_stats();
+	}
+	return true;
+}
+
+double audio_engine::get_wait_ms()
+{
+	double wait_ms = AUDIO_ENGINE_IDLE_MS;
+	std::lock_guard<std::mutex> lock(mut);
+#ifndef NO_THREADS
+	if(!workers.empty())
+	{
+		return wait_ms;
+	}
+#endif
+	for(auto& entry : streams)
+	{
+		if(entry->opening.load())
+		{
+			continue;
+		}
+		std::lock_guard<std::mutex> entry_lock(entry->mut);
+		//sounds don't need refilling.
+		if(!entry->finished.load() && !entry->sound)
+		{
+			//refill before the queue gets low.
+			wait_ms = std::min(wait_ms, entry->stream.get_buffer_seconds() * 1000.0 / 2.0);
+		}
+	}
+	return wait_ms;
+}
+
+bool audio_engine::check_pulse_ms(int timeout_ms)
+{
+#ifndef NO_THREADS
+	for(auto& worker : workers)
+	{
+		if(!worker->thread.check_pulse_ms(timeout_ms))
+		{
+			return false;
+		}
+	}
+#else
+	(void)timeout_ms;
+#endif
+	return true;
+}
+
+#ifndef NO_THREADS
+void audio_engine::worker_run(worker_state* worker)
+{
+	debug_thread_raii context_raii(&worker->thread);
+
+	std::vector<std::shared_ptr<engine_stream>> active;
+	while(true)
+	{
+		worker->thread.pulse();
+
+		{
+			std::lock_guard<std::mutex> lock(mut);
+			for(auto& entry : streams)
+			{
+				if(entry->worker == worker->index && !entry->finished.load() && !entry->opening.load())
+				{
+					active.push_back(entry);
+				}
+			}
+		}
+
+		//the engine mutex isn't held while decoding, so play() and stop() don't wait on the decoder.
+		double wait_ms = AUDIO_ENGINE_IDLE_MS;
+		for(auto& entry : active)
+		{
+			std::lock_guard<std::mutex> entry_lock(entry->mut);
+			update_stream(*entry);
+			if(!entry->finished.load() && !entry->sound)
+			{
+				//wake up before the queue gets low.
+				wait_ms = std::min(wait_ms, entry->stream.get_buffer_seconds() * 1000.0 / 2.0);
+			}
+		}
+		//don't keep stopped streams alive while waiting.
+		active.clear();
+
+		std::unique_lock<std::mutex> lock(mut);
+		if(cond.wait_for(lock, std::chrono::milliseconds(std::max(static_cast<int>(wait_ms), AUDIO_ENGINE_MIN_WAIT_MS)),
+						 [this] { return stop_requested; }))
+		{
+			break;
+		}
+	}
+}
+#endif
+
+int audio_engine::take_voice(const char* path, int priority)
+{
+	if(!free_voices.empty())
+	{
+		int voice = free_voices.back();
+		free_voices.pop_back();
+		return voice;
+	}
+	int voice = steal_voice(priority);
+	if(voice == -1)
+	{
+		serrf("audio_engine: no voice for `%s` (priority: %d, voices: %d)\n",
+			  path, priority, static_cast<int>(voices.size()));
+	}
+	return voice;
+}
+
+int audio_engine::add_stream(const std::shared_ptr<engine_stream>& entry)
+{
+	entry->handle = next_handle++;
+	entry->order = next_order++;
+#ifndef NO_THREADS
+	if(!workers.empty())
+	{
+		//round robin.
+		entry->worker = entry->handle % static_cast<int>(workers.size());
+	}
+#endif
+	streams.push_back(entry);
+	return entry->handle;
+}
+
+std::shared_ptr<audio_engine::engine_stream> audio_engine::find_stream(int handle)
+{
+	for(auto& entry : streams)
+	{
+		if(entry->handle == handle)
+		{
+			return entry;
+		}
+	}
+	return std::shared_ptr<engine_stream>();
+}
+
+int audio_engine::steal_voice(int priority)
+{
+	engine_stream* victim = NULL;
+	for(auto& entry : streams)
+	{
+		if(entry->voice == -1 || entry->opening.load() || entry->priority > priority)
+		{
+			continue;
+		}
+		//finished streams are free, they just weren't released yet.
+		if(entry->finished.load())
+		{
+			victim = entry.get();
+			break;
+		}
+		if(victim == NULL || entry->priority < victim->priority ||
+		   (entry->priority == victim->priority && entry->order < victim->order))
+		{
+			victim = entry.get();
+		}
+	}
+	if(victim == NULL)
+	{
+		return -1;
+	}
+
+	std::lock_guard<std::mutex> entry_lock(victim->mut);
+	if(!victim->finished.load())
+	{
+		slogf("audio_engine: `%s` lost its voice\n", victim->path.c_str());
+	}
+	release_stream(*victim);
+	//the stream is erased by update() (unless it failed).
+	ASSERT(!free_voices.empty());
+	int voice = free_voices.back();
+	free_voices.pop_back();
+	return voice;
+}
+
+void audio_engine::release_stream(engine_stream& entry)
+{
+	entry.finished = true;
+	if(entry.voice == -1)
+	{
+		return;
+	}
+	if(entry.sound)
+	{
+		ALuint source = voices[entry.voice].source;
+		alSourceRewind(source);
+		alSourcei(source, AL_BUFFER, 0);
+		if(!alerr("Failed to detach sound"))
+		{
+			entry.error += serr_get_error();
+		}
+		//the cache can evict it now.
+		entry.sound.reset();
+	}
+	else if(!entry.stream.close())
+	{
+		entry.error += serr_get_error();
+	}
+	free_voices.push_back(entry.voice);
+	entry.voice = -1;
+}
+
+void audio_engine::update_stream(engine_stream& entry)
+{
+	if(entry.finished.load())
+	{
+		return;
+	}
+
+	TIMER_U start = timer_now();
+	bool success;
+	if(entry.sound)
+	{
+		ALint state = AL_STOPPED;
+		alGetSourcei(voices[entry.voice].source, AL_SOURCE_STATE, &state);
+		success = alerr("Error checking sound state");
+		if(success && state == AL_STOPPED)
+		{
+			entry.finished = true;
+		}
+	}
+	else
+	{
+		success = entry.stream.update();
+		if(success && !entry.stream.is_playing())
+		{
+			entry.finished = true;
+		}
+	}
+	entry.update_ms += timer_delta<TIMER_MS>(start, timer_now());
+	++entry.update_count;
+
+	if(!success)
+	{
+		//one broken stream shouldn't stop the rest.
+		entry.error = serr_get_error();
+		slogf("audio_engine: `%s` failed:\n%s", entry.path.c_str(), entry.error.c_str());
+		entry.finished = true;
+	}
+}
+
+void audio_engine::print_stats()
+{
+	TIMER_U now = timer_now();
+	TIMER_RESULT elapsed_sec = timer_delta<TIMER_SEC>(stats_time, now);
+	stats_time = now;
+	if(elapsed_sec <= 0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mut);
+
+	TIMER_RESULT total_ms = 0;
+	size_t total_bytes = 0;
+	Uint32 total_ring_underruns = 0;
+	Uint32 total_source_underruns = 0;
+	int playing = 0;
+	for(auto& entry : streams)
+	{
+		if(entry->opening.load())
+		{
+			continue;
+		}
+		std::lock_guard<std::mutex> entry_lock(entry->mut);
+		if(entry->voice == -1)
+		{
+			continue;
+		}
+		++playing;
+		size_t bytes = entry->stream.get_memory_bytes();
+		Uint32 ring_underruns = entry->stream.get_ring_underruns();
+		Uint32 source_underruns = entry->stream.get_source_underruns();
+		slogf("\t[%d] %s (priority: %d): %.3f ms/s (%u updates), %zu KB, underruns: ring %u, source %u\n",
+			  entry->handle, entry->path.c_str(), entry->priority, entry->update_ms / elapsed_sec,
+			  entry->update_count, bytes / 1024, ring_underruns, source_underruns);
+		if(!entry->sound)
+		{
+			//the entry is locked, so the telemetry isn't being updated.
+			const AL_StreamTelemetry& telemetry = entry->stream.get_telemetry();
+			slogf("\t\tbuffers: %d x %d frames, min queued: %d, grows: %u, shrinks: %u\n",
+				  telemetry.buffer_count, telemetry.buffer_frames, telemetry.window_min_queued,
+				  telemetry.grows, telemetry.shrinks);
+			slogf("\t\tahead: %.1f ms (ring: %.1f, queued: %.1f), device latency: %.1f ms, update max: %.3f ms\n",
+				  telemetry.ring_ms + telemetry.queued_ms, telemetry.ring_ms, telemetry.queued_ms,
+				  telemetry.device_latency_ms, telemetry.update_max_ms);
+		}
+		total_ms += entry->update_ms;
+		total_bytes += bytes;
+		total_ring_underruns += ring_underruns;
+		total_source_underruns += source_underruns;
+		entry->update_ms = 0;
+		entry->update_count = 0;
+	}
+	slogf("audio: %d streams, %d/%d voices, %.3f ms/s, %zu KB, underruns: ring %u, source %u\n",
+		  playing, static_cast<int>(voices.size() - free_voices.size()), static_cast<int>(voices.size()),
+		  total_ms / elapsed_sec, total_bytes / 1024, total_ring_underruns, total_source_underruns);
+}
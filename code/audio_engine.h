@@ -0,0 +1,141 @@
+#pragma once
+
+//plays many AL_OggStream's at once (music layers, ambient loops),
+//the streams share a pool of sources and buffers, and a few threads decode all of them.
+
+//when there are no free voices, the lowest priority (then the oldest) stream is stopped,
+//but only if it isn't a higher priority than the new stream.
+enum AUDIO_PRIORITY
+{
+	AUDIO_PRIORITY_AMBIENT = 0,
+	AUDIO_PRIORITY_MUSIC = 100
+};
+
+class audio_engine
+{
+public:
+	~audio_engine()
+	{
+		//the destructor cannot capture serr, so I can only resort to ASSERT.
+		//you should never rely on the destructor.
+		if(!destroy())
+		{
+			ASSERT(false && "destroy");
+		}
+	}
+
+	//creates the sources and buffers (openal must be initialized).
+	MYNODISCARD bool init();
+
+	//use_threads = false means update() decodes the streams.
+	//started separately from init, so the early returns don't need to join anything.
+	void start(bool use_threads);
+
+	//asks the workers to finish and joins them.
+	//returns false if a worker timed out (read serr and exit, like debug_thread).
+	MYNODISCARD bool join(int timeout_ms);
+
+	//DONT CALL THIS BEFORE JOINING
+	//prints the stats and returns the errors of the workers.
+	std::string get_errors();
+
+	//stops every stream and deletes the sources and buffers (join first).
+	MYNODISCARD bool destroy();
+
+	//moves the audio to another device (NULL = default), like when the current one was unplugged.
+	//with ALC_SOFT_reopen_device nothing is interrupted, otherwise the device is recreated:
+	//the streams continue from where they were decoded, the queued audio and playing sounds are lost.
+	//if this fails the engine has no device, destroy it.
+	MYNODISCARD bool switch_device(const char* device_name, sound_cache* sounds);
+
+	//returns a handle, or 0 on error.
+	//a voice might be stolen from a lower priority stream.
+	MYNODISCARD int play(const char* path, int flags = AL_STREAM_NONE, int priority = AUDIO_PRIORITY_AMBIENT, float gain = 1.f);
+
+	//plays a cached sound (no decoding), the ref is held until it finishes.
+	MYNODISCARD int play_sound(const sound_ref& sound, int priority = AUDIO_PRIORITY_AMBIENT, float gain = 1.f);
+
+	void stop(int handle);
+
+	//false if the stream ended, failed, or the voice was stolen.
+	bool is_playing(int handle);
+
+	//the error that stopped the stream, empty if none.
+	std::string get_error(int handle);
+
+	//call this every frame.
+	//releases the voices of finished streams, and decodes the streams if there are no workers.
+	//returns false if a worker quit.
+	MYNODISCARD bool update();
+
+	//how long update() can wait without the streams running out (without workers).
+	double get_wait_ms();
+
+	MYNODISCARD bool check_pulse_ms(int timeout_ms);
+
+private:
+	struct engine_stream
+	{
+		//held while the stream is being updated.
+		std::mutex mut;
+		AL_OggStream stream;
+		//if set, the stream isn't used.
+		sound_ref sound;
+		std::string path;
+		std::string error;
+		int handle = 0;
+		int priority = 0;
+		//for stealing the oldest.
+		Uint32 order = 0;
+		int voice = -1;
+		int worker = 0;
+		//ended, failed or stolen, the voice is released by update().
+		std::atomic_bool finished{false};
+		//play() is opening the stream without the engine mutex (but with this one),
+		//it isn't updated, stolen or released until this is cleared.
+		std::atomic_bool opening{false};
+
+		//reset every time the stats are printed.
+		TIMER_RESULT update_ms = 0;
+		Uint32 update_count = 0;
+	};
+
+	std::mutex mut;
+	std::vector<std::shared_ptr<engine_stream>> streams;
+	std::vector<AL_StreamVoice> voices;
+	std::vector<int> free_voices;
+	std::vector<ALuint> sources;
+	std::vector<ALuint> buffers;
+	int next_handle = 1;
+	Uint32 next_order = 0;
+	TIMER_U stats_time;
+
+#ifndef NO_THREADS
+	struct worker_state
+	{
+		debug_thread thread;
+		int index = 0;
+	};
+	std::vector<std::unique_ptr<worker_state>> workers;
+	std::condition_variable cond;
+	bool stop_requested = false;
+
+	void worker_run(worker_state* worker);
+#endif
+
+	//the pool of sources and buffers.
+	MYNODISCARD bool create_voices();
+	MYNODISCARD bool delete_voices();
+
+	//the engine mutex must be locked.
+	std::shared_ptr<engine_stream> find_stream(int handle);
+	int steal_voice(int priority);
+	int take_voice(const char* path, int priority);
+	int add_stream(const std::shared_ptr<engine_stream>& entry);
+	void release_stream(engine_stream& entry);
+
+	//the stream mutex must be locked.
+	void update_stream(engine_stream& entry);
+
+	void print_stats();
+};
@@ -0,0 +1,441 @@
+#include "global.h"
+
+#include "SDL_wrapper.h"
+#include "cvar.h"
+#include "batch_read.h"
+
+#include <string.h> //strerror
+#include <errno.h> //errno
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h> //mmap
+#include <sys/stat.h> //fstat
+#include <sys/syscall.h> //syscall
+#include <sys/uio.h> //iovec
+#include <fcntl.h> //open
+#include <unistd.h> //close
+//liburing isn't used, the raw syscalls are enough for reads.
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAS_IO_URING
+#endif
+#endif
+
+static cvar& cv_batch_read = register_cvar_value(
+	"cv_batch_read", 1, "how startup files are read, 0 = one at a time, 1 = io_uring (or threads), 2 = threads", CVAR_STARTUP);
+static cvar& cv_batch_read_threads = register_cvar_value(
+	"cv_batch_read_threads", 4, "the threads reading files when io_uring isn't used", CVAR_STARTUP);
+
+//big files are split, so one file can have many reads in flight.
+#define BATCH_READ_CHUNK (1024 * 1024)
+//the most reads in flight.
+#define BATCH_READ_QUEUE_DEPTH 64
+
+//this is the fallback, it works with anything RWops can open.
+static void read_one_file(batch_read_request& request)
+{
+	Unique_RWops file = Unique_RWops_OpenFS(request.path, "rb");
+	if(file)
+	{
+		long file_size = -1;
+		if(file->seek(0, SEEK_END) == 0)
+		{
+			file_size = file->tell();
+		}
+		if(file_size >= 0 && file->seek(0, SEEK_SET) == 0)
+		{
+			std::unique_ptr<char[]> memory(new char[file_size]);
+			if(file->read(memory.get(), 1, file_size) == static_cast<size_t>(file_size))
+			{
+				request.file = Unique_RWops_FromHeap(std::move(memory), file_size, request.path);
+			}
+			else if(!serr_check_error())
+			{
+				serrf("Failed to read: `%s`, reason: the file is shorter than its size\n", request.path);
+			}
+		}
+		file.reset();
+	}
+	//the serr buffer belongs to this thread, so the error moves to the request.
+	if(serr_check_error())
+	{
+		request.file.reset();
+		request.error = serr_get_error();
+	}
+}
+
+static void read_with_threads(batch_read_request* requests, size_t count)
+{
+#ifndef NO_THREADS
+	size_t thread_count = std::min<size_t>(std::max(static_cast<int>(cv_batch_read_threads.get_value()), 1), count);
+	std::atomic<size_t> next_request(0);
+	auto worker = [&]() {
+		size_t index;
+		while((index = next_request.fetch_add(1)) < count)
+		{
+			read_one_file(requests[index]);
+		}
+	};
+	//the calling thread works too.
+	std::vector<std::thread> threads;
+	for(size_t i = 1; i < thread_count; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for(std::thread& thread : threads)
+	{
+		thread.join();
+	}
+#else
+	for(size_t i = 0; i < count; ++i)
+	{
+		read_one_file(requests[i]);
+	}
+#endif
+}
+
+#ifdef HAS_IO_URING
+
+struct uring_file
+{
+	int fd = -1;
+	std::unique_ptr<char[]> memory;
+	size_t size = 0;
+	//the chunks that haven't completed.
+	int pending = 0;
+	bool failed = false;
+};
+
+struct uring_read
+{
+	size_t file_index;
+	size_t offset;
+	iovec vec;
+};
+
+class io_uring_reader
+{
+public:
+	int ring_fd = -1;
+	io_uring_params params;
+	void* sq_map = MAP_FAILED;
+	void* cq_map = MAP_FAILED;
+	size_t sq_map_size = 0;
+	size_t cq_map_size = 0;
+	io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+
+	unsigned* sq_tail = NULL;
+	unsigned* sq_mask = NULL;
+	unsigned* sq_array = NULL;
+	unsigned* cq_head = NULL;
+	unsigned* cq_tail = NULL;
+	unsigned* cq_mask = NULL;
+	io_uring_cqe* cqes = NULL;
+
+	~io_uring_reader()
+	{
+		if(sqes != MAP_FAILED)
+		{
+			munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+		}
+		if(cq_map != MAP_FAILED && cq_map != sq_map)
+		{
+			munmap(cq_map, cq_map_size);
+		}
+		if(sq_map != MAP_FAILED)
+		{
+			munmap(sq_map, sq_map_size);
+		}
+		if(ring_fd >= 0)
+		{
+			close(ring_fd);
+		}
+	}
+
+	//false means io_uring can't be used (the reason is in serr).
+	MYNODISCARD bool init(unsigned entries)
+	{
+		memset(&params, 0, sizeof(params));
+		ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+		if(ring_fd < 0)
+		{
+			serrf("io_uring_setup failed, reason: %s\n", strerror(errno));
+			return false;
+		}
+
+		sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if(single_mmap)
+		{
+			sq_map_size = std::max(sq_map_size, cq_map_size);
+		}
+		sq_map = mmap(NULL, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+		if(sq_map == MAP_FAILED)
+		{
+			serrf("io_uring: failed to map the submission ring, reason: %s\n", strerror(errno));
+			return false;
+		}
+		cq_map = (single_mmap ? sq_map : mmap(NULL, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING));
+		if(cq_map == MAP_FAILED)
+		{
+			serrf("io_uring: failed to map the completion ring, reason: %s\n", strerror(errno));
+			return false;
+		}
+		sqes = static_cast<io_uring_sqe*>(mmap(NULL, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+											   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+		if(sqes == MAP_FAILED)
+		{
+			serrf("io_uring: failed to map the submission entries, reason: %s\n", strerror(errno));
+			return false;
+		}
+
+		char* sq = static_cast<char*>(sq_map);
+		char* cq = static_cast<char*>(cq_map);
+		sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		return true;
+	}
+
+	//the kernel only reads the tail, so only the tail needs a barrier.
+	void push_read(int fd, uring_read* read)
+	{
+		unsigned tail = *sq_tail;
+		unsigned index = tail & *sq_mask;
+		io_uring_sqe* sqe = &sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		//READV is the oldest read op (5.1).
+		sqe->opcode = IORING_OP_READV;
+		sqe->fd = fd;
+		sqe->off = read->offset;
+		sqe->addr = reinterpret_cast<Uint64>(&read->vec);
+		sqe->len = 1;
+		sqe->user_data = reinterpret_cast<Uint64>(read);
+		sq_array[index] = index;
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+	}
+
+	//submits and waits for at least one completion.
+	MYNODISCARD bool enter(unsigned submit_count)
+	{
+		while(true)
+		{
+			long out = syscall(__NR_io_uring_enter, ring_fd, submit_count, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+			if(out >= 0)
+			{
+				return true;
+			}
+			if(errno != EINTR)
+			{
+				serrf("io_uring_enter failed, reason: %s\n", strerror(errno));
+				return false;
+			}
+		}
+	}
+
+	template<class F>
+	void reap(F&& on_complete)
+	{
+		unsigned head = *cq_head;
+		unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+		for(; head != tail; ++head)
+		{
+			const io_uring_cqe& cqe = cqes[head & *cq_mask];
+			on_complete(reinterpret_cast<uring_read*>(cqe.user_data), cqe.res);
+		}
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+	}
+};
+
+//false means the batch didn't run, the caller should use the fallback.
+//errors of single files go to the requests.
+static bool read_with_io_uring(batch_read_request* requests, size_t count)
+{
+	io_uring_reader ring;
+	if(!ring.init(BATCH_READ_QUEUE_DEPTH))
+	{
+		return false;
+	}
+
+	//opening is synchronous, the metadata is usually cached anyway.
+	std::vector<uring_file> files(count);
+	std::deque<uring_read> reads;
+	for(size_t i = 0; i < count; ++i)
+	{
+		uring_file& file = files[i];
+		file.fd = open(requests[i].path, O_RDONLY | O_CLOEXEC);
+		if(file.fd < 0)
+		{
+			requests[i].error = std::string("Failed to open: `") + requests[i].path + "`, reason: " + strerror(errno) + "\n";
+			continue;
+		}
+		struct stat file_stat;
+		if(fstat(file.fd, &file_stat) != 0)
+		{
+			requests[i].error = std::string("Failed to stat: `") + requests[i].path + "`, reason: " + strerror(errno) + "\n";
+			file.failed = true;
+			continue;
+		}
+		file.size = static_cast<size_t>(file_stat.st_size);
+		file.memory.reset(new char[file.size]);
+		for(size_t offset = 0; offset < file.size; offset += BATCH_READ_CHUNK)
+		{
+			uring_read read;
+			read.file_index = i;
+			read.offset = offset;
+			read.vec.iov_base = file.memory.get() + offset;
+			read.vec.iov_len = std::min<size_t>(BATCH_READ_CHUNK, file.size - offset);
+			//a deque doesn't move the elements, the kernel holds pointers to them.
+			reads.push_back(read);
+			++file.pending;
+		}
+	}
+
+	bool success = true;
+	size_t next_read = 0;
+	unsigned in_flight = 0;
+	std::vector<uring_read*> resubmit;
+	while(next_read < reads.size() || in_flight != 0 || !resubmit.empty())
+	{
+		unsigned submit_count = 0;
+		//short reads continue where they stopped.
+		while(!resubmit.empty() && in_flight < ring.params.sq_entries)
+		{
+			ring.push_read(files[resubmit.back()->file_index].fd, resubmit.back());
+			resubmit.pop_back();
+			++submit_count;
+			++in_flight;
+		}
+		while(next_read < reads.size() && in_flight < ring.params.sq_entries)
+		{
+			ring.push_read(files[reads[next_read].file_index].fd, &reads[next_read]);
+			++next_read;
+			++submit_count;
+			++in_flight;
+		}
+		if(!ring.enter(submit_count))
+		{
+			//the kernel could still write into the buffers, so they can't be freed.
+			success = false;
+			break;
+		}
+		ring.reap([&](uring_read* read, int result) {
+			--in_flight;
+			uring_file& file = files[read->file_index];
+			batch_read_request& request = requests[read->file_index];
+			if(result < 0 || (result == 0 && read->vec.iov_len != 0))
+			{
+				if(!file.failed)
+				{
+					request.error = std::string("Failed to read: `") + request.path + "`, reason: " +
+									(result < 0 ? strerror(-result) : "the file is shorter than its size") + "\n";
+				}
+				file.failed = true;
+				--file.pending;
+				return;
+			}
+			size_t got = static_cast<size_t>(result);
+			if(got < read->vec.iov_len)
+			{
+				read->offset += got;
+				read->vec.iov_base = static_cast<char*>(read->vec.iov_base) + got;
+				read->vec.iov_len -= got;
+				resubmit.push_back(read);
+				return;
+			}
+			--file.pending;
+		});
+	}
+
+	if(!success)
+	{
+		//the reads in flight could still land in the memory, so leak it instead of crashing.
+		slog("warning: io_uring failed mid batch, leaking the buffers\n");
+		for(uring_file& file : files)
+		{
+			(void)file.memory.release();
+			if(file.fd >= 0)
+			{
+				close(file.fd);
+			}
+		}
+		return false;
+	}
+
+	for(size_t i = 0; i < count; ++i)
+	{
+		uring_file& file = files[i];
+		if(file.fd < 0)
+		{
+			continue;
+		}
+		close(file.fd);
+		if(!file.failed)
+		{
+			ASSERT(file.pending == 0);
+			requests[i].file = Unique_RWops_FromHeap(std::move(file.memory), file.size, requests[i].path);
+		}
+	}
+	return true;
+}
+
+#endif // HAS_IO_URING
+
+void batch_read_files(batch_read_request* requests, size_t count)
+{
+	TIMER_U start = timer_now();
+	int mode = static_cast<int>(cv_batch_read.get_value());
+	const char* method = "sequential";
+	bool done = false;
+#ifdef HAS_IO_URING
+	if(mode == 1)
+	{
+		done = read_with_io_uring(requests, count);
+		if(done)
+		{
+			method = "io_uring";
+		}
+		else
+		{
+			slogf("warning: %s", serr_get_error().c_str());
+			//a failed batch could have filled some requests.
+			for(size_t i = 0; i < count; ++i)
+			{
+				requests[i].file.reset();
+				requests[i].error.clear();
+			}
+		}
+	}
+#endif
+	if(!done && mode != 0)
+	{
+		read_with_threads(requests, count);
+		method = "threads";
+		done = true;
+	}
+	if(!done)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			read_one_file(requests[i]);
+		}
+	}
+
+	size_t total_bytes = 0;
+	for(size_t i = 0; i < count; ++i)
+	{
+		if(requests[i].file)
+		{
+			total_bytes += requests[i].file->size();
+		}
+	}
+	TIMER_RESULT ms = timer_delta<TIMER_MS>(start, timer_now());
+	slogf("batch read (%s): %zu files, %zu KB, %.2f ms, %.1f MB/s\n", method, count, total_bytes / 1024, ms,
+		  (ms > 0 ? (total_bytes / (1024.0 * 1024.0)) / (ms / 1000.0) : 0.0));
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+//reads a list of files into memory at once, so the disk latencies overlap instead of adding up.
+//on linux this uses io_uring, otherwise (or if io_uring is blocked, like in some containers)
+//a few threads read the files in parallel (see cv_batch_read).
+struct batch_read_request
+{
+	//must outlive the file (it is the stream name).
+	const char* path = NULL;
+	//a readonly memory file with the whole contents, NULL on error.
+	Unique_RWops file;
+	//why the file couldn't be read, the batch doesn't use serr because a missing file could be normal.
+	std::string error;
+};
+
+//prints the time and the throughput into slog.
+void batch_read_files(batch_read_request* requests, size_t count);
@@ -0,0 +1,470 @@
+#include "global.h"
+
+#include "SDL_wrapper.h"
+#include "compressed_rwops.h"
+
+#include <string.h> //memcmp
+
+//only the declarations, gl_wrapper.cpp has the implementation (which includes zlib for png).
+#include "stb/stb_image.h"
+
+static_assert(sizeof(deflate_chunks_header) == 24, "the header is written as is");
+
+//the window of deflate.
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+//how many older matches are checked, more is smaller but slower.
+#define DEFLATE_MAX_CHAIN 32
+#define DEFLATE_HASH_BITS 15
+//a sanity check so a corrupt header won't allocate something huge (a chunk is decoded into memory).
+#define DEFLATE_CHUNKS_MAX_SIZE (16 * 1024 * 1024)
+
+class RWops_Inflate : public RWops
+{
+public:
+	RWops* source;
+	bool autoclose;
+	deflate_chunks_header header;
+	std::vector<Uint64> chunk_offsets;
+	long data_start;
+	Uint64 position = 0;
+
+	//the decoded chunk.
+	std::unique_ptr<char[]> chunk;
+	Sint64 chunk_index = -1;
+	size_t chunk_length = 0;
+	std::vector<char> compressed;
+
+	RWops_Inflate(RWops* stream, bool autoclose_, const deflate_chunks_header& header_, std::vector<Uint64>&& offsets, long start)
+	: source(stream)
+	, autoclose(autoclose_)
+	, header(header_)
+	, chunk_offsets(std::move(offsets))
+	, data_start(start)
+	, chunk(new char[header_.chunk_size])
+	{
+		ASSERT(stream != NULL);
+		stream_info = stream->stream_info;
+	}
+
+	bool load_chunk(Sint64 index)
+	{
+		ASSERT(index >= 0 && static_cast<Uint64>(index) < header.chunk_count);
+		chunk_index = -1;
+		Uint64 start = chunk_offsets[index];
+		size_t compressed_size = static_cast<size_t>(chunk_offsets[index + 1] - start);
+		const char* input = NULL;
+		if(source->data() != NULL)
+		{
+			//a mapped file or a pack entry, no copy.
+			input = source->data() + data_start + start;
+		}
+		else
+		{
+			compressed.resize(compressed_size);
+			if(source->seek(data_start + static_cast<long>(start), SEEK_SET) != 0 ||
+			   source->read(compressed.data(), 1, compressed_size) != compressed_size)
+			{
+				if(!serr_check_error())
+				{
+					serrf("Error reading from datastream: `%s`, reason: the chunk %lld is cut off\n", stream_info,
+						  static_cast<long long>(index));
+				}
+				return false;
+			}
+			input = compressed.data();
+		}
+
+		size_t expected = header.chunk_size;
+		if(static_cast<Uint64>(index) == header.chunk_count - 1)
+		{
+			expected = static_cast<size_t>(header.size - static_cast<Uint64>(index) * header.chunk_size);
+		}
+		int decoded = stbi_zlib_decode_buffer(chunk.get(), header.chunk_size, input, static_cast<int>(compressed_size));
+		if(decoded < 0 || static_cast<size_t>(decoded) != expected)
+		{
+			serrf("Error reading from datastream: `%s`, reason: the chunk %lld is corrupt (%s)\n", stream_info,
+				  static_cast<long long>(index), (decoded < 0 ? stbi_failure_reason() : "wrong size"));
+			return false;
+		}
+		chunk_index = index;
+		chunk_length = expected;
+		return true;
+	}
+
+	size_t read(void *ptr, size_t size, size_t nmemb) override
+	{
+		if(size == 0)
+		{
+			return 0;
+		}
+		char* out = static_cast<char*>(ptr);
+		size_t wanted = size * nmemb;
+		if(wanted > header.size - position)
+		{
+			//eof isn't an error.
+			wanted = static_cast<size_t>(header.size - position);
+		}
+		size_t copied = 0;
+		while(copied < wanted)
+		{
+			Sint64 index = static_cast<Sint64>(position / header.chunk_size);
+			if(index != chunk_index && !load_chunk(index))
+			{
+				break;
+			}
+			size_t offset = static_cast<size_t>(position - static_cast<Uint64>(index) * header.chunk_size);
+			size_t amount = std::min(chunk_length - offset, wanted - copied);
+			memcpy(out + copied, chunk.get() + offset, amount);
+			copied += amount;
+			position += amount;
+		}
+		return copied / size;
+	}
+	size_t write(const void *ptr, size_t size, size_t nmemb) override
+	{
+		(void)ptr;
+		(void)size;
+		(void)nmemb;
+		serrf("Error writing to datastream: `%s`, reason: compressed streams are read only\n", stream_info);
+		return 0;
+	}
+	int seek(long offset, int whence) override
+	{
+		long base;
+		switch(whence)
+		{
+		case SEEK_SET: base = 0; break;
+		case SEEK_CUR: base = static_cast<long>(position); break;
+		case SEEK_END: base = static_cast<long>(header.size); break;
+		default:
+			serrf("Error seeking in datastream: `%s`, reason: invalid whence (whence: %d)\n", stream_info, whence);
+			return -1;
+		}
+		if(offset < -base || offset > static_cast<long>(header.size) - base)
+		{
+			serrf("Error seeking in datastream: `%s`, reason: out of bounds (offset: %ld, whence: %d, size: %llu)\n",
+				  stream_info, offset, whence, static_cast<unsigned long long>(header.size));
+			return -1;
+		}
+		//the chunk is decoded when it's read.
+		position = static_cast<Uint64>(base + offset);
+		return 0;
+	}
+	long tell() override
+	{
+		return static_cast<long>(position);
+	}
+	bool eof() override
+	{
+		return position == header.size;
+	}
+	~RWops_Inflate() override
+	{
+		if(autoclose)
+		{
+			delete source;
+		}
+	}
+};
+
+Unique_RWops Unique_RWops_Inflate(RWops* file, bool autoclose)
+{
+	ASSERT(file != NULL);
+	//the source is deleted on error too.
+	std::unique_ptr<RWops> owner(autoclose ? file : NULL);
+
+	long start = file->tell();
+	deflate_chunks_header header;
+	if(start < 0 || file->read(&header, sizeof(header), 1) != 1)
+	{
+		if(!serr_check_error())
+		{
+			serrf("Failed to open: `%s`, reason: the compressed header is cut off\n", file->stream_info);
+		}
+		return Unique_RWops();
+	}
+	if(memcmp(header.magic, DEFLATE_CHUNKS_MAGIC, sizeof(header.magic)) != 0 || header.chunk_size == 0 ||
+	   header.chunk_size > DEFLATE_CHUNKS_MAX_SIZE ||
+	   header.chunk_count != header.size / header.chunk_size + (header.size % header.chunk_size != 0 ? 1 : 0))
+	{
+		serrf("Failed to open: `%s`, reason: not a compressed stream\n", file->stream_info);
+		return Unique_RWops();
+	}
+	long table_start = file->tell();
+	long file_end = -1;
+	if(table_start >= 0 && file->seek(0, SEEK_END) == 0)
+	{
+		file_end = file->tell();
+	}
+	if(file_end < table_start || file->seek(table_start, SEEK_SET) != 0)
+	{
+		if(!serr_check_error())
+		{
+			serrf("Failed to open: `%s`, reason: the compressed stream isn't seekable\n", file->stream_info);
+		}
+		return Unique_RWops();
+	}
+	//the table must fit in the stream before it is allocated.
+	Uint64 table_bytes = (static_cast<Uint64>(header.chunk_count) + 1) * sizeof(Uint64);
+	if(table_bytes > static_cast<Uint64>(file_end - table_start))
+	{
+		serrf("Failed to open: `%s`, reason: the chunk offsets are cut off\n", file->stream_info);
+		return Unique_RWops();
+	}
+	std::vector<Uint64> offsets(static_cast<size_t>(header.chunk_count) + 1);
+	if(file->read(offsets.data(), sizeof(Uint64), offsets.size()) != offsets.size())
+	{
+		if(!serr_check_error())
+		{
+			serrf("Failed to open: `%s`, reason: the chunk offsets are cut off\n", file->stream_info);
+		}
+		return Unique_RWops();
+	}
+	long data_start = table_start + static_cast<long>(table_bytes);
+	//the chunks are checked here, so reading doesn't need to.
+	for(Uint32 i = 0; i < header.chunk_count; ++i)
+	{
+		if(offsets[i] > offsets[i + 1] || offsets[i + 1] > static_cast<Uint64>(file_end - data_start))
+		{
+			serrf("Failed to open: `%s`, reason: the chunk %u is out of bounds\n", file->stream_info, i);
+			return Unique_RWops();
+		}
+	}
+	(void)owner.release();
+	return std::make_unique<RWops_Inflate>(file, autoclose, header, std::move(offsets), data_start);
+}
+
+//bits are packed from the lowest bit.
+class deflate_bit_writer
+{
+public:
+	std::vector<char> bytes;
+	Uint32 bit_buffer = 0;
+	int bit_count = 0;
+
+	void add(Uint32 code, int count)
+	{
+		bit_buffer |= code << bit_count;
+		bit_count += count;
+		while(bit_count >= 8)
+		{
+			bytes.push_back(static_cast<char>(bit_buffer & 0xff));
+			bit_buffer >>= 8;
+			bit_count -= 8;
+		}
+	}
+	void flush()
+	{
+		if(bit_count > 0)
+		{
+			add(0, 8 - bit_count);
+		}
+	}
+	//the huffman codes are stored from the highest bit.
+	void add_reversed(Uint32 code, int count)
+	{
+		Uint32 reversed = 0;
+		for(int i = 0; i < count; ++i)
+		{
+			reversed = (reversed << 1) | (code & 1);
+			code >>= 1;
+		}
+		add(reversed, count);
+	}
+	//the fixed literal/length code.
+	void add_symbol(int symbol)
+	{
+		if(symbol <= 143)
+			add_reversed(0x30 + symbol, 8);
+		else if(symbol <= 255)
+			add_reversed(0x190 + symbol - 144, 9);
+		else if(symbol <= 279)
+			add_reversed(symbol - 256, 7);
+		else
+			add_reversed(0xc0 + symbol - 280, 8);
+	}
+};
+
+static const int deflate_length_base[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+										  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 259};
+static const int deflate_length_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+										   3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const int deflate_dist_base[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+										257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32769};
+static const int deflate_dist_extra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+										 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static Uint32 deflate_adler32(const unsigned char* data, size_t size)
+{
+	Uint32 a = 1;
+	Uint32 b = 0;
+	while(size != 0)
+	{
+		//the sums can't overflow in this many bytes.
+		size_t block = std::min<size_t>(size, 5552);
+		for(size_t i = 0; i < block; ++i)
+		{
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += block;
+		size -= block;
+	}
+	return (b << 16) | a;
+}
+
+static Uint32 deflate_hash(const unsigned char* data)
+{
+	Uint32 value = data[0] | (data[1] << 8) | (data[2] << 16);
+	return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+//one final block with the fixed codes, and greedy matching (like stb_image_write).
+static void deflate_chunk(const unsigned char* data, size_t size, deflate_bit_writer& writer,
+						  std::vector<int>& head, std::vector<int>& prev)
+{
+	std::fill(head.begin(), head.end(), -1);
+	prev.resize(size);
+
+	//BFINAL = 1, BTYPE = 01 (fixed)
+	writer.add(1, 1);
+	writer.add(1, 2);
+
+	size_t i = 0;
+	while(i < size)
+	{
+		int best_length = 0;
+		int best_dist = 0;
+		if(i + DEFLATE_MIN_MATCH <= size)
+		{
+			Uint32 hash = deflate_hash(data + i);
+			int max_length = static_cast<int>(std::min<size_t>(DEFLATE_MAX_MATCH, size - i));
+			int candidate = head[hash];
+			for(int chain = 0; candidate >= 0 && chain < DEFLATE_MAX_CHAIN; ++chain)
+			{
+				if(i - candidate > DEFLATE_WINDOW - 1)
+				{
+					break;
+				}
+				int length = 0;
+				while(length < max_length && data[candidate + length] == data[i + length])
+				{
+					++length;
+				}
+				if(length > best_length)
+				{
+					best_length = length;
+					best_dist = static_cast<int>(i - candidate);
+					if(length == max_length)
+					{
+						break;
+					}
+				}
+				candidate = prev[candidate];
+			}
+		}
+
+		size_t step = (best_length >= DEFLATE_MIN_MATCH ? best_length : 1);
+		//every position goes into the hash chain, so later matches can find it.
+		for(size_t j = i; j < i + step && j + DEFLATE_MIN_MATCH <= size; ++j)
+		{
+			Uint32 hash = deflate_hash(data + j);
+			prev[j] = head[hash];
+			head[hash] = static_cast<int>(j);
+		}
+
+		if(best_length >= DEFLATE_MIN_MATCH)
+		{
+			int code = 0;
+			while(best_length > deflate_length_base[code + 1] - 1)
+			{
+				++code;
+			}
+			writer.add_symbol(code + 257);
+			if(deflate_length_extra[code] != 0)
+			{
+				writer.add(best_length - deflate_length_base[code], deflate_length_extra[code]);
+			}
+			code = 0;
+			while(best_dist > deflate_dist_base[code + 1] - 1)
+			{
+				++code;
+			}
+			writer.add_reversed(code, 5);
+			if(deflate_dist_extra[code] != 0)
+			{
+				writer.add(best_dist - deflate_dist_base[code], deflate_dist_extra[code]);
+			}
+		}
+		else
+		{
+			writer.add_symbol(data[i]);
+		}
+		i += step;
+	}
+	//end of block
+	writer.add_symbol(256);
+	writer.flush();
+}
+
+bool deflate_chunks(const char* data, size_t size, RWops* out, Uint32 chunk_size)
+{
+	ASSERT(data != NULL || size == 0);
+	ASSERT(out != NULL);
+	ASSERT(chunk_size > 0 && chunk_size <= DEFLATE_CHUNKS_MAX_SIZE);
+
+	deflate_chunks_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DEFLATE_CHUNKS_MAGIC, sizeof(header.magic));
+	header.chunk_size = chunk_size;
+	header.size = size;
+	header.chunk_count = static_cast<Uint32>((size + chunk_size - 1) / chunk_size);
+
+	std::vector<Uint64> offsets(header.chunk_count + 1, 0);
+	long table_start = out->tell();
+	//the offsets are written again at the end.
+	if(table_start < 0 || out->write(&header, sizeof(header), 1) != 1 ||
+	   out->write(offsets.data(), sizeof(Uint64), offsets.size()) != offsets.size())
+	{
+		return false;
+	}
+
+	std::vector<int> head(1 << DEFLATE_HASH_BITS);
+	std::vector<int> prev;
+	deflate_bit_writer writer;
+	Uint64 written = 0;
+	for(Uint32 i = 0; i < header.chunk_count; ++i)
+	{
+		size_t offset = static_cast<size_t>(i) * chunk_size;
+		size_t length = std::min<size_t>(chunk_size, size - offset);
+		const unsigned char* input = reinterpret_cast<const unsigned char*>(data) + offset;
+		//zlib streams, stb's inflater needs the trailer (it reads ahead).
+		writer.bytes.assign({0x78, 0x01});
+		deflate_chunk(input, length, writer, head, prev);
+		Uint32 adler = deflate_adler32(input, length);
+		for(int shift = 24; shift >= 0; shift -= 8)
+		{
+			writer.bytes.push_back(static_cast<char>((adler >> shift) & 0xff));
+		}
+		if(out->write(writer.bytes.data(), 1, writer.bytes.size()) != writer.bytes.size())
+		{
+			return false;
+		}
+		offsets[i] = written;
+		written += writer.bytes.size();
+	}
+	offsets[header.chunk_count] = written;
+
+	long end = out->tell();
+	if(out->seek(table_start + static_cast<long>(sizeof(header)), SEEK_SET) != 0 ||
+	   out->write(offsets.data(), sizeof(Uint64), offsets.size()) != offsets.size() ||
+	   out->seek(end, SEEK_SET) != 0)
+	{
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+//a deflate stream split into independent chunks (zlib streams), every chunk is a restart point,
+//so seeking only decodes the chunk it lands in, and the memory is one chunk (not the whole file).
+//the inflater is stb_image's, stb has no compressor, so deflate_chunks has a small one (fixed huffman codes).
+//the format: the header, then chunk_count + 1 offsets (relative to the end of the offsets), then the chunks.
+//the numbers are little endian.
+
+#define DEFLATE_CHUNKS_MAGIC "DZC1"
+#define DEFLATE_CHUNKS_DEFAULT_SIZE (64 * 1024)
+
+struct deflate_chunks_header
+{
+	char magic[4];
+	Uint32 chunk_size;
+	Uint64 size;
+	Uint32 chunk_count;
+	Uint32 reserved;
+};
+
+//decompresses a deflate_chunks stream that starts at tell().
+//readonly, data() is NULL, the source must stay alive if autoclose is false.
+Unique_RWops Unique_RWops_Inflate(RWops* file, bool autoclose = false);
+
+//compresses the memory into out (which must be able to seek back to write the offsets).
+MYNODISCARD bool deflate_chunks(const char* data, size_t size, RWops* out, Uint32 chunk_size = DEFLATE_CHUNKS_DEFAULT_SIZE);
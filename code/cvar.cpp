@@ -174,7 +174,7 @@ bool cvar_config_file()
 		return true;
 	}
 	const char* config_path = cv_config_file.get_string().c_str();
-	Unique_RWops config_file(Unique_RWops_OpenFS(config_path, "rb"));
+	Unique_RWops config_file(Unique_RWops_OpenMapped(config_path, RWOPS_MAP_SEQUENTIAL));
 	if(!config_file)
 	{
 		//eat the error, config files aren't required.
@@ -0,0 +1,173 @@
+#include "global.h"
+
+#include "SDL_wrapper.h"
+#include "json_wrapper.h"
+#include "cvar.h"
+#include "frame_stats.h"
+
+#include <math.h>
+
+static cvar& cv_frame_stats_window = register_cvar_value(
+	"cv_frame_stats_window", 600, "the number of recent frames used for the frame time percentiles", CVAR_STARTUP);
+static cvar& cv_frame_stats_log_ms = register_cvar_value(
+	"cv_frame_stats_log_ms", 10000, "how often the frame time percentiles are printed, 0 = never", CVAR_DEFAULT);
+
+//if the update falls behind, the producer drops samples instead of waiting.
+#define FRAME_STATS_RING_SIZE 1024
+
+static const char* stat_names[] = {"cpu_ms", "swap_ms", "present_interval_ms"};
+
+frame_stats::frame_stats()
+: ring(FRAME_STATS_RING_SIZE)
+, window(std::max(static_cast<int>(cv_frame_stats_window.get_value()), 1))
+, log_time(timer_now())
+{
+}
+
+void frame_stats::add_sample(const frame_sample& sample)
+{
+	//a full ring just loses the sample.
+	(void)ring.push(sample);
+}
+
+float frame_stats::get_stat(const frame_sample& sample, int stat)
+{
+	switch(stat)
+	{
+	case STAT_CPU: return sample.cpu_ms;
+	case STAT_SWAP: return sample.swap_ms;
+	case STAT_PRESENT: return sample.present_interval_ms;
+	}
+	ASSERT(false && "unknown stat");
+	return 0;
+}
+
+void frame_stats::update(double refresh_ms)
+{
+	last_refresh_ms = refresh_ms;
+
+	frame_sample sample;
+	while(ring.pop(sample))
+	{
+		++total_frames;
+		window[window_pos] = sample;
+		window_pos = (window_pos + 1) % window.size();
+		window_count = std::min(window_count + 1, window.size());
+
+		for(int stat = 0; stat < STAT_COUNT; ++stat)
+		{
+			float value = get_stat(sample, stat);
+			if(stat == STAT_PRESENT && value == 0)
+			{
+				continue;
+			}
+			int bin = std::min(static_cast<int>(value), FRAME_STATS_HISTOGRAM_BINS - 1);
+			++histogram[stat][std::max(bin, 0)];
+		}
+
+		//a frame that took 2 intervals missed 1 vsync.
+		if(refresh_ms > 0 && sample.present_interval_ms > refresh_ms * 1.5)
+		{
+			missed_vsync += static_cast<Uint64>(lround(sample.present_interval_ms / refresh_ms)) - 1;
+		}
+	}
+
+	if(cv_frame_stats_log_ms.get_value() > 0)
+	{
+		TIMER_U now = timer_now();
+		if(timer_delta<TIMER_MS>(log_time, now) >= cv_frame_stats_log_ms.get_value() && window_count != 0)
+		{
+			log_time = now;
+			percentiles cpu = calc_percentiles(STAT_CPU);
+			percentiles swap = calc_percentiles(STAT_SWAP);
+			percentiles present = calc_percentiles(STAT_PRESENT);
+			slogf("frame ms (p50/p95/p99/max): cpu: %.2f/%.2f/%.2f/%.2f, swap: %.2f/%.2f/%.2f/%.2f, present: %.2f/%.2f/%.2f/%.2f, missed vsync: %llu\n",
+				cpu.p50, cpu.p95, cpu.p99, cpu.max,
+				swap.p50, swap.p95, swap.p99, swap.max,
+				present.p50, present.p95, present.p99, present.max,
+				static_cast<unsigned long long>(missed_vsync));
+		}
+	}
+}
+
+frame_stats::percentiles frame_stats::calc_percentiles(int stat)
+{
+	percentiles result;
+	std::vector<float> values;
+	values.reserve(window_count);
+	for(size_t i = 0; i < window_count; ++i)
+	{
+		float value = get_stat(window[i], stat);
+		//skipped frames don't have an interval.
+		if(stat == STAT_PRESENT && value == 0)
+		{
+			continue;
+		}
+		values.push_back(value);
+	}
+	if(values.empty())
+	{
+		return result;
+	}
+
+	auto nth = [&](double percent) -> float {
+		size_t index = std::min(static_cast<size_t>(values.size() * percent), values.size() - 1);
+		std::nth_element(values.begin(), values.begin() + index, values.end());
+		return values[index];
+	};
+	result.p50 = nth(0.50);
+	result.p95 = nth(0.95);
+	result.p99 = nth(0.99);
+	result.max = *std::max_element(values.begin(), values.end());
+	return result;
+}
+
+bool frame_stats::dump_json(const char* path)
+{
+	ASSERT(path != NULL);
+	update(last_refresh_ms);
+
+	Unique_RWops file = Unique_RWops_OpenFS(path, "wb");
+	if(!file)
+	{
+		return false;
+	}
+
+	json_context json;
+	json.create(file->stream_info);
+	json.set_member("frames", static_cast<uint64_t>(total_frames));
+	json.set_member("missed_vsync", static_cast<uint64_t>(missed_vsync));
+	json.set_member("refresh_ms", last_refresh_ms);
+	json.set_member("window_frames", static_cast<uint64_t>(window_count));
+	json.set_member("histogram_bin_ms", 1);
+
+	for(int stat = 0; stat < STAT_COUNT; ++stat)
+	{
+		percentiles result = calc_percentiles(stat);
+		json.push_set_object_member(stat_names[stat]);
+		json.set_member("p50", result.p50);
+		json.set_member("p95", result.p95);
+		json.set_member("p99", result.p99);
+		json.set_member("max", result.max);
+		json.push_set_array_member("histogram");
+		json.set_array(histogram[stat], histogram[stat] + FRAME_STATS_HISTOGRAM_BINS);
+		json.pop(); //"histogram"
+		json.pop(); //stat_names[stat]
+	}
+
+	if(serr_check_error())
+	{
+		return false;
+	}
+	if(!json.write(file.get()))
+	{
+		return false;
+	}
+	file.reset();
+	if(serr_check_error())
+	{
+		return false;
+	}
+	slogf("frame stats written to: %s\n", path);
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "spsc_ring.h"
+
+struct frame_sample
+{
+	//the time spent making the frame (before the swap)
+	float cpu_ms = 0;
+	//the time the swap blocked (usually vsync)
+	float swap_ms = 0;
+	//the time between the end of the previous swap and this swap, 0 if the previous frame was skipped.
+	float present_interval_ms = 0;
+};
+
+//1 ms per bin, the last bin is everything above.
+#define FRAME_STATS_HISTOGRAM_BINS 100
+
+//records the frame times into a ring, so the thread that swaps never waits for the stats.
+//the percentiles are from the last cv_frame_stats_window frames, the histogram is from the whole run.
+class frame_stats
+{
+public:
+	frame_stats();
+
+	//the producer, call after the swap.
+	void add_sample(const frame_sample& sample);
+
+	//the consumer, reads the ring and prints the log (cv_frame_stats_log_ms).
+	//refresh_ms is the vsync interval, 0 = vsync is off (no missed vsync detection).
+	void update(double refresh_ms);
+
+	//writes the histogram and percentiles (calls update first)
+	MYNODISCARD bool dump_json(const char* path);
+
+private:
+	enum
+	{
+		STAT_CPU,
+		STAT_SWAP,
+		STAT_PRESENT,
+		STAT_COUNT
+	};
+	struct percentiles
+	{
+		float p50 = 0;
+		float p95 = 0;
+		float p99 = 0;
+		float max = 0;
+	};
+
+	spsc_ring<frame_sample> ring;
+
+	//rolling window for the percentiles
+	std::vector<frame_sample> window;
+	size_t window_pos = 0;
+	size_t window_count = 0;
+
+	Uint32 histogram[STAT_COUNT][FRAME_STATS_HISTOGRAM_BINS]{};
+	Uint64 total_frames = 0;
+	Uint64 missed_vsync = 0;
+	double last_refresh_ms = 0;
+	TIMER_U log_time;
+
+	percentiles calc_percentiles(int stat);
+	static float get_stat(const frame_sample& sample, int stat);
+};
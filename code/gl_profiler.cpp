@@ -0,0 +1,223 @@
+#include "global.h"
+#include "gl_profiler.h"
+#include "cvar.h"
+
+static cvar& cv_gpu_profiler = register_cvar_value(
+	"cv_gpu_profiler", 1, "0 = off, 1 = measure the gpu time of each render pass with timer queries (not on software renderers)", CVAR_STARTUP);
+static cvar& cv_gpu_profiler_log_ms = register_cvar_value(
+	"cv_gpu_profiler_log_ms", 5000, "how often the gpu pass times are printed, 0 = never", CVAR_DEFAULT);
+static cvar& cv_gpu_profiler_smoothing = register_cvar_value(
+	"cv_gpu_profiler_smoothing", 0.1, "the weight of a new sample in the rolling average, 1 = no smoothing", CVAR_DEFAULT);
+
+static bool is_software_renderer()
+{
+    const char* renderer = reinterpret_cast<const char*>(ctx.glGetString(GL_RENDERER));
+    if(renderer == NULL)
+    {
+        return false;
+    }
+    //mesa, google, and windows without a driver.
+    const char* software_renderers[] = {"llvmpipe", "softpipe", "SwiftShader", "Software Rasterizer", "GDI Generic"};
+    for(const char* name : software_renderers)
+    {
+        if(strstr(renderer, name) != NULL)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool gl_profiler::init()
+{
+    ASSERT(!active && pass_count == 0);
+
+    if(cv_gpu_profiler.get_value() == 0.0)
+    {
+        return true;
+    }
+
+#ifdef DESKTOP_GL
+    const char* extension = "GL_ARB_timer_query";
+#else
+    const char* extension = "GL_EXT_disjoint_timer_query";
+#endif
+    if(SDL_GL_ExtensionSupported(extension) != SDL_TRUE || ctx.glGenQueries == NULL || ctx.glDeleteQueries == NULL ||
+        ctx.glBeginQuery == NULL || ctx.glEndQuery == NULL || ctx.glGetQueryObjectuiv == NULL || ctx.glGetQueryObjectui64v == NULL)
+    {
+        slogf("info: gpu profiler disabled, %s is not supported\n", extension);
+        return true;
+    }
+
+    if(is_software_renderer())
+    {
+        slogf("info: gpu profiler disabled, software renderer: %s\n", reinterpret_cast<const char*>(ctx.glGetString(GL_RENDERER)));
+        return true;
+    }
+
+    active = true;
+    frame_slot = 0;
+    dropped_samples = 0;
+    log_time = timer_now();
+    return true;
+}
+
+bool gl_profiler::destroy()
+{
+    for(int i = 0; i < pass_count; ++i)
+    {
+        if(passes[i].queries[0] != 0)
+        {
+            GL_CHECK( ctx.glDeleteQueries(GL_PROFILER_FRAMES, passes[i].queries) );
+        }
+        passes[i] = pass_info();
+    }
+    pass_count = 0;
+    current_pass = -1;
+    active = false;
+    return !serr_check_error();
+}
+
+int gl_profiler::add_pass(const char* name)
+{
+    ASSERT(name != NULL);
+    if(!active)
+    {
+        return -1;
+    }
+    if(pass_count == GL_PROFILER_MAX_PASSES)
+    {
+        slogf("warning: gpu profiler: too many passes, ignoring: %s\n", name);
+        return -1;
+    }
+    pass_info& pass = passes[pass_count];
+    GL_CHECK_ERR_MSG( ctx.glGenQueries(GL_PROFILER_FRAMES, pass.queries), return -1, name );
+    pass.name = name;
+    return pass_count++;
+}
+
+void gl_profiler::begin_pass(int pass)
+{
+    if(!active || pass < 0)
+    {
+        return;
+    }
+    ASSERT(pass < pass_count);
+    ASSERT(current_pass == -1 && "gpu profiler passes cannot overlap");
+    current_pass = pass;
+    GL_RUNTIME( ctx.glBeginQuery(GL_TIME_ELAPSED, passes[pass].queries[frame_slot]) );
+    passes[pass].issued[frame_slot] = true;
+}
+
+void gl_profiler::end_pass()
+{
+    if(!active || current_pass == -1)
+    {
+        return;
+    }
+    GL_RUNTIME( ctx.glEndQuery(GL_TIME_ELAPSED) );
+    current_pass = -1;
+}
+
+void gl_profiler::end_frame()
+{
+    if(!active)
+    {
+        return;
+    }
+    ASSERT(current_pass == -1 && "end_frame inside of a pass");
+
+    //the oldest frame in the ring is about to be reused.
+    frame_slot = (frame_slot + 1) % GL_PROFILER_FRAMES;
+
+    bool disjoint = false;
+#ifndef DESKTOP_GL
+    //the results are garbage if the gpu changed it's clock or something.
+    GLint disjoint_occurred = 0;
+    GL_RUNTIME( ctx.glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint_occurred) );
+    disjoint = (disjoint_occurred != 0);
+#endif
+
+    double smoothing = cv_gpu_profiler_smoothing.get_value();
+    for(int i = 0; i < pass_count; ++i)
+    {
+        pass_info& pass = passes[i];
+        if(!pass.issued[frame_slot])
+        {
+            continue;
+        }
+        pass.issued[frame_slot] = false;
+
+        GLuint available = 0;
+        GL_RUNTIME( ctx.glGetQueryObjectuiv(pass.queries[frame_slot], GL_QUERY_RESULT_AVAILABLE, &available) );
+        if(available == 0 || disjoint)
+        {
+            ++dropped_samples;
+            continue;
+        }
+
+        Uint64 elapsed_ns = 0;
+        GL_RUNTIME( ctx.glGetQueryObjectui64v(pass.queries[frame_slot], GL_QUERY_RESULT, &elapsed_ns) );
+        double elapsed_ms = static_cast<double>(elapsed_ns) / 1000000.0;
+
+        pass.average_ms = (pass.average_ms < 0) ? elapsed_ms : (pass.average_ms + (elapsed_ms - pass.average_ms) * smoothing);
+        pass.period_total_ms += elapsed_ms;
+        pass.period_max_ms = std::max(pass.period_max_ms, elapsed_ms);
+        ++pass.period_samples;
+    }
+
+    if(cv_gpu_profiler_log_ms.get_value() > 0)
+    {
+        TIMER_U now = timer_now();
+        if(timer_delta<TIMER_MS>(log_time, now) >= cv_gpu_profiler_log_ms.get_value())
+        {
+            log_time = now;
+            print_log();
+        }
+    }
+}
+
+double gl_profiler::get_pass_ms(int pass) const
+{
+    if(!active || pass < 0)
+    {
+        return -1;
+    }
+    ASSERT(pass < pass_count);
+    return passes[pass].average_ms;
+}
+
+double gl_profiler::get_total_ms() const
+{
+    double total_ms = 0;
+    for(int i = 0; i < pass_count; ++i)
+    {
+        if(passes[i].average_ms > 0)
+        {
+            total_ms += passes[i].average_ms;
+        }
+    }
+    return total_ms;
+}
+
+void gl_profiler::print_log()
+{
+    std::string line = "gpu ms (avg/max):";
+    char buffer[200];
+    double total_ms = 0;
+    for(int i = 0; i < pass_count; ++i)
+    {
+        pass_info& pass = passes[i];
+        double average_ms = (pass.period_samples == 0) ? 0 : pass.period_total_ms / pass.period_samples;
+        total_ms += average_ms;
+        snprintf(buffer, sizeof(buffer), " %s: %.3f/%.3f,", pass.name, average_ms, pass.period_max_ms);
+        line += buffer;
+        pass.period_total_ms = 0;
+        pass.period_max_ms = 0;
+        pass.period_samples = 0;
+    }
+    snprintf(buffer, sizeof(buffer), " total: %.3f, dropped: %d\n", total_ms, dropped_samples);
+    line += buffer;
+    dropped_samples = 0;
+    slog(line.c_str());
+}
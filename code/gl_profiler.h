@@ -0,0 +1,66 @@
+#pragma once
+
+#include "gl_wrapper.h"
+
+//measures the gpu time of render passes with timer queries (GL_ARB_timer_query / GL_EXT_disjoint_timer_query).
+//the results are read GL_PROFILER_FRAMES frames later, so reading never waits for the gpu.
+//if the results are still not ready, the sample is dropped.
+//does nothing if cv_gpu_profiler is 0, timer queries are unsupported, or the renderer is a software rasterizer
+//(llvmpipe measures the time the cpu spends queuing the commands, which is meaningless).
+
+#define GL_PROFILER_FRAMES 4
+#define GL_PROFILER_MAX_PASSES 8
+
+class gl_profiler
+{
+public:
+    //call after the context is loaded, the passes can be added after.
+    MYNODISCARD bool init();
+    //call before the context is destroyed.
+    MYNODISCARD bool destroy();
+
+    //returns the index for begin_pass, returns -1 if the profiler is inactive.
+    //the name must have a static lifetime.
+    int add_pass(const char* name);
+
+    //passes cannot overlap (timer queries can't be nested).
+    void begin_pass(int pass);
+    void end_pass();
+
+    //reads the results from old frames, and prints the log (cv_gpu_profiler_log_ms).
+    void end_frame();
+
+    bool is_active() const
+    {
+        return active;
+    }
+
+    //the rolling average, -1 if there are no results yet.
+    double get_pass_ms(int pass) const;
+    //the sum of the rolling averages of all the passes.
+    double get_total_ms() const;
+
+private:
+    struct pass_info
+    {
+        const char* name = NULL;
+        GLuint queries[GL_PROFILER_FRAMES]{};
+        bool issued[GL_PROFILER_FRAMES]{};
+        //the rolling average
+        double average_ms = -1;
+        //for the log
+        double period_total_ms = 0;
+        double period_max_ms = 0;
+        int period_samples = 0;
+    };
+    pass_info passes[GL_PROFILER_MAX_PASSES];
+    int pass_count = 0;
+    int current_pass = -1;
+
+    int frame_slot = 0;
+    int dropped_samples = 0;
+    bool active = false;
+    TIMER_U log_time;
+
+    void print_log();
+};
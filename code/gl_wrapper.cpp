@@ -1,5 +1,13 @@
 #include "global.h"
 #include "gl_wrapper.h"
+#include "cvar.h"
+#include "mini_tools.h"
+
+#include <string.h> //strerror
+#include <errno.h> //errno
+
+static cvar& cv_shader_cache = register_cvar_string(
+	"cv_shader_cache", "shader_cache_", "prefix of the program binary cache files (can include a folder), empty = disabled", CVAR_DEFAULT);
 
 GLES2_Context ctx;
 
@@ -72,15 +80,7 @@ static void stbRWopsSkip(void *user, int n)
 // returns nonzero if we are at end of file/data
 static int stbRWopsEOF(void *user)
 {
-    //yea stdio offers an EOF function, but why would you need it?
-    int old_tell = static_cast<RWops*>(user)->tell();
-    static_cast<RWops*>(user)->seek(0, SEEK_END);
-    int new_tell = static_cast<RWops*>(user)->tell();
-    if(old_tell != new_tell)
-    {
-        static_cast<RWops*>(user)->seek(old_tell, SEEK_SET);
-    }
-    return (old_tell == new_tell);
+    return static_cast<RWops*>(user)->eof();
 }
 
 static stbi_io_callbacks g_stbRWopsCallbacks {stbRWopsRead,stbRWopsSkip, stbRWopsEOF};
@@ -128,7 +128,24 @@ void STB_Array_Deleter::operator()(int* data)
 Unique_StbImageData load_binary_texture(RWops* file, int* w, int* h, bool* rgba)
 {
     int channels;
-    Unique_StbImageData stb_data(stbi_load_from_callbacks(&g_stbRWopsCallbacks, file, w, h, &channels, 0));
+    Unique_StbImageData stb_data;
+    if(file->data() != NULL)
+    {
+        //mapped files skip the callbacks.
+        long offset = file->tell();
+        stb_data.reset(stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(file->data() + offset),
+                                             static_cast<int>(file->size() - offset), w, h, &channels, 0));
+    }
+    else
+    {
+        //stb does a lot of small reads and skips.
+        Unique_RWops buffered = Unique_RWops_Buffered(file);
+        if(!buffered)
+        {
+            return stb_data;
+        }
+        stb_data.reset(stbi_load_from_callbacks(&g_stbRWopsCallbacks, buffered.get(), w, h, &channels, 0));
+    }
     if(!stb_data)
     {
         serrf("Could not load image: %s in `%s`\n", stbi_failure_reason(), file->stream_info);
@@ -230,23 +247,31 @@ GLuint load_animated_gif(RWops* file, GLint filtering, int* w, int* h, int* colu
     TIMER_U t1 = timer_now();
 #endif
     
-    if(file->seek(0, SEEK_END) != 0)
-    {
-        serrf("SDL_RWseek: file stream can't seek\n");
-        return 0;
-    }
-    int file_length = file->tell();
-    if(file->seek(0, SEEK_SET) != 0)
+    //mapped files are used directly.
+    std::unique_ptr<unsigned char[]> file_copy;
+    const unsigned char* file_memory = reinterpret_cast<const unsigned char*>(file->data());
+    int file_length = static_cast<int>(file->size());
+    if(file_memory == NULL)
     {
-        serrf("SDL_RWseek: file stream can't seek\n");
-        return 0;
-    }
-    std::unique_ptr<unsigned char[]> file_memory(new unsigned char[file_length]);
+        if(file->seek(0, SEEK_END) != 0)
+        {
+            serrf("SDL_RWseek: file stream can't seek\n");
+            return 0;
+        }
+        file_length = file->tell();
+        if(file->seek(0, SEEK_SET) != 0)
+        {
+            serrf("SDL_RWseek: file stream can't seek\n");
+            return 0;
+        }
+        file_copy.reset(new unsigned char[file_length]);
 
-    if(static_cast<int>(file->read(file_memory.get(), 1, file_length)) != file_length)
-    {
-        serrf("SDL_RWread: could not read the file\n");
-        return 0;
+        if(static_cast<int>(file->read(file_copy.get(), 1, file_length)) != file_length)
+        {
+            serrf("SDL_RWread: could not read the file\n");
+            return 0;
+        }
+        file_memory = file_copy.get();
     }
 
 #ifdef GIF_TIMER
@@ -265,7 +290,7 @@ GLuint load_animated_gif(RWops* file, GLint filtering, int* w, int* h, int* colu
     //and this would be very fast to load compared to loading the whole gif into frames.
     //also stb_image has a problem that some gifs will just cause a stack overflow due to stb using a bunch of recursion.
     //but giflib animation streaming is complicated (even just using it to get the same result as stb using slurp isn't simple).
-    Unique_StbImageData stb_data(stbi_load_gif_from_memory(file_memory.get(), file_length, &delays_get, w, h, frames, &channels, 0));
+    Unique_StbImageData stb_data(stbi_load_gif_from_memory(file_memory, file_length, &delays_get, w, h, frames, &channels, 0));
     if(!stb_data)
     {
         serrf("Could not load image: %s in `%s`\n", stbi_failure_reason(), file->stream_info);
@@ -430,7 +455,91 @@ GLuint load_animated_gif(RWops* file, GLint filtering, int* w, int* h, int* colu
     return 0;
 }
 
-static GLuint compile_shader(GLchar* shader_script, GLenum type, const char* file_info)
+bool framebuffer_supported()
+{
+    return ctx.glGenFramebuffers != NULL && ctx.glBindFramebuffer != NULL && ctx.glFramebufferTexture2D != NULL &&
+        ctx.glCheckFramebufferStatus != NULL && ctx.glDeleteFramebuffers != NULL;
+}
+
+bool create_framebuffer(gl_framebuffer& fb, int width, int height, GLint filtering)
+{
+    ASSERT(fb.fbo_id == 0 && fb.texture_id == 0);
+    ASSERT(width > 0 && height > 0);
+
+    if(!framebuffer_supported())
+    {
+        serr("framebuffer objects are not supported (requires GL_ARB_framebuffer_object)\n");
+        return false;
+    }
+
+    fb.width = width;
+    fb.height = height;
+
+    //tricky unwinding.
+    do{
+        GL_CHECK_ERR( ctx.glGenTextures(1, &fb.texture_id), break );
+        GL_CHECK_ERR( ctx.glBindTexture(GL_TEXTURE_2D, fb.texture_id), break );
+        GL_CHECK_ERR( ctx.glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL), break );
+        GL_CHECK_ERR( ctx.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filtering), break );
+        GL_CHECK_ERR( ctx.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtering), break );
+        GL_CHECK_ERR( ctx.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE), break );
+        GL_CHECK_ERR( ctx.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE), break );
+        GL_SANITY( ctx.glBindTexture(GL_TEXTURE_2D, 0) );
+
+        GL_CHECK_ERR( ctx.glGenFramebuffers(1, &fb.fbo_id), break );
+        GL_CHECK_ERR( ctx.glBindFramebuffer(GL_FRAMEBUFFER, fb.fbo_id), break );
+        GL_CHECK_ERR( ctx.glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fb.texture_id, 0), break );
+
+        GLenum status;
+        GL_CHECK_ERR( status = ctx.glCheckFramebufferStatus(GL_FRAMEBUFFER), break );
+        GL_SANITY( ctx.glBindFramebuffer(GL_FRAMEBUFFER, 0) );
+        if(status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            serrf("%s: incomplete framebuffer (0x%.8x), size: %d x %d\n", __FUNCTION__, status, width, height);
+            break;
+        }
+
+        //success
+        return true;
+    } while(false);
+
+    destroy_framebuffer(fb);
+    return false;
+}
+
+void destroy_framebuffer(gl_framebuffer& fb)
+{
+    fb.width = 0;
+    fb.height = 0;
+    if(fb.fbo_id != 0)
+    {
+        GL_CHECK( ctx.glDeleteFramebuffers(1, &fb.fbo_id) );
+        fb.fbo_id = 0;
+    }
+    if(fb.texture_id != 0)
+    {
+        GL_CHECK( ctx.glDeleteTextures(1, &fb.texture_id) );
+        fb.texture_id = 0;
+    }
+}
+
+bool checksum_framebuffer(int width, int height, Uint64* out)
+{
+    ASSERT(out != NULL);
+    ASSERT(width > 0 && height > 0);
+
+    //RGBA + GL_UNSIGNED_BYTE is the only combination that es2 guarantees.
+    std::unique_ptr<GLubyte[]> pixels(new GLubyte[static_cast<size_t>(width) * height * 4]);
+    //rows are tightly packed, so the checksum doesn't depend on the alignment.
+    GL_CHECK_ERR( ctx.glPixelStorei(GL_PACK_ALIGNMENT, 1), return false );
+    GL_CHECK_ERR( ctx.glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.get()), return false );
+    *out = fnv1a_hash(pixels.get(), static_cast<size_t>(width) * height * 4);
+    return true;
+}
+
+//this doesn't check the compile status, because that forces the driver to wait for the compile,
+//check_shader_status is called after the program is linked.
+static GLuint begin_compile_shader(GLchar* shader_script, GLenum type, const char* file_info)
 {
     ASSERT(shader_script != NULL);
     ASSERT(file_info != NULL);
@@ -440,27 +549,6 @@ static GLuint compile_shader(GLchar* shader_script, GLenum type, const char* fil
     do {
         GL_CHECK_ERR_MSG( ctx.glShaderSource(shader_id, 1, &shader_script, NULL), break, file_info );
         GL_CHECK_ERR_MSG( ctx.glCompileShader(shader_id), break, file_info );
-
-        GLint compile_status;
-        GL_CHECK_ERR_MSG( ctx.glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compile_status), break, file_info );
-        if (compile_status == 0)
-        {
-            GLint log_length;
-            GLint infoLogLength;
-
-            GL_CHECK_ERR_MSG( ctx.glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &log_length), break, file_info );
-            std::unique_ptr<char[]> message(new char[log_length]);
-            GL_CHECK_ERR_MSG( ctx.glGetShaderInfoLog(shader_id, log_length, &infoLogLength, message.get()), break, file_info );
-            if(infoLogLength > 0)
-            {
-                serrf("%s:\n%s\n", file_info, message.get());
-            }
-            else
-            {
-                serrf("%s: infoLogLength returned %d\n", file_info, infoLogLength);
-            }
-            break;
-        }
         //success
         return shader_id;
     } while(false);
@@ -471,61 +559,332 @@ static GLuint compile_shader(GLchar* shader_script, GLenum type, const char* fil
     return 0;
 }
 
-static GLuint create_program(const char* program_info, GLchar* vertex_shader, const char* vertex_info, GLchar* fragment_shader, const char* fragment_info)
+//returns false and prints the info log if the shader failed to compile.
+static bool check_shader_status(GLuint shader_id, const char* file_info)
+{
+    GLint compile_status;
+    GL_CHECK_ERR_MSG( ctx.glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compile_status), return false, file_info );
+    if (compile_status == 0)
+    {
+        GLint log_length;
+        GLint infoLogLength;
+
+        GL_CHECK_ERR_MSG( ctx.glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &log_length), return false, file_info );
+        std::unique_ptr<char[]> message(new char[log_length]);
+        GL_CHECK_ERR_MSG( ctx.glGetShaderInfoLog(shader_id, log_length, &infoLogLength, message.get()), return false, file_info );
+        if(infoLogLength > 0)
+        {
+            serrf("%s:\n%s\n", file_info, message.get());
+        }
+        else
+        {
+            serrf("%s: infoLogLength returned %d\n", file_info, infoLogLength);
+        }
+        return false;
+    }
+    return true;
+}
+
+//the program binary cache is only a hint, so any errors are warnings.
+//the binary must match the driver exactly, so the key includes the driver strings.
+//the file is just the header followed by the binary.
+struct shader_cache_header
+{
+    char magic[4];
+    Uint32 binary_format;
+    Uint32 binary_length;
+    Uint32 reserved;
+    Uint64 key;
+};
+#define SHADER_CACHE_MAGIC "DSC1"
+//a sanity check so a corrupt file won't allocate something huge.
+#define SHADER_CACHE_MAX_LENGTH (64 * 1024 * 1024)
+
+static bool shader_cache_supported()
+{
+    if(cv_shader_cache.get_string().empty())
+    {
+        return false;
+    }
+    if(ctx.glGetProgramBinary == NULL || ctx.glProgramBinary == NULL)
+    {
+        return false;
+    }
+    if(SDL_GL_ExtensionSupported("GL_ARB_get_program_binary") != SDL_TRUE && 
+        SDL_GL_ExtensionSupported("GL_OES_get_program_binary") != SDL_TRUE)
+    {
+        return false;
+    }
+    //some drivers support the extension, but don't have any formats (mesa used to do this).
+    GLint format_count = 0;
+    GL_CHECK_ERR( ctx.glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count), return false );
+    return format_count > 0;
+}
+
+static Uint64 shader_cache_key(const GLchar* vertex_shader, const GLchar* fragment_shader)
 {
+    Uint64 key = fnv1a_hash(SHADER_CACHE_MAGIC, 4);
+    const GLenum driver_strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    for(GLenum name : driver_strings)
+    {
+        const char* str = reinterpret_cast<const char*>(ctx.glGetString(name));
+        if(str != NULL)
+        {
+            key = fnv1a_hash(str, strlen(str), key);
+        }
+    }
+    key = fnv1a_hash(vertex_shader, strlen(vertex_shader), key);
+    key = fnv1a_hash(fragment_shader, strlen(fragment_shader), key);
+    return key;
+}
+
+static std::string shader_cache_path(const char* program_info)
+{
+    std::string path = cv_shader_cache.get_string();
+    path += program_info;
+    path += ".bin";
+    return path;
+}
+
+//returns 0 if there is no usable binary, the caller should compile the program instead.
+static GLuint begin_cached_program(const char* program_info, Uint64 key)
+{
+    std::string path = shader_cache_path(program_info);
+    //I don't use Unique_RWops_OpenFS because a missing file is normal.
+    FILE* fp = fopen(path.c_str(), "rb");
+    if(fp == NULL)
+    {
+        return 0;
+    }
+    shader_cache_header header;
+    std::unique_ptr<char[]> binary;
+    bool valid = (fread(&header, sizeof(header), 1, fp) == 1 &&
+        memcmp(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.key == key &&
+        header.binary_length != 0 && header.binary_length <= SHADER_CACHE_MAX_LENGTH);
+    if(valid)
+    {
+        binary.reset(new char[header.binary_length]);
+        valid = (fread(binary.get(), 1, header.binary_length, fp) == header.binary_length);
+    }
+    fclose(fp);
+    if(!valid)
+    {
+        //probably a different driver, this is expected.
+        return 0;
+    }
+
+    //glProgramBinary will give GL_INVALID_ENUM for an unknown format, which I don't want to show up in the debug callback.
+    GLint format_count = 0;
+    GL_CHECK_ERR( ctx.glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count), return 0 );
+    std::unique_ptr<GLint[]> formats(new GLint[format_count]);
+    GL_CHECK_ERR( ctx.glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.get()), return 0 );
+    if(std::find(formats.get(), formats.get() + format_count, static_cast<GLint>(header.binary_format)) == formats.get() + format_count)
+    {
+        return 0;
+    }
+
     GLuint program_id;
     GL_CHECK_ERR( program_id = ctx.glCreateProgram(), return 0 );
-    
-    GLuint vertex_id = 0;
-    GLuint fragment_id = 0;
-    do {
-        vertex_id = compile_shader(vertex_shader, GL_VERTEX_SHADER, vertex_info);
-        if(vertex_id == 0)
+    //the link status is checked by end_program, a rejected binary is not an error.
+    GL_CHECK_ERR_MSG( ctx.glProgramBinary(program_id, header.binary_format, binary.get(), header.binary_length),
+        ctx.glDeleteProgram(program_id); return 0, program_info );
+    return program_id;
+}
+
+static void save_cached_program(const char* program_info, GLuint program_id, Uint64 key)
+{
+    GLint binary_length = 0;
+    GL_CHECK_ERR( ctx.glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &binary_length), return );
+    if(binary_length <= 0 || binary_length > SHADER_CACHE_MAX_LENGTH)
+    {
+        return;
+    }
+
+    std::unique_ptr<char[]> binary(new char[binary_length]);
+    shader_cache_header header;
+    memcpy(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic));
+    header.reserved = 0;
+    header.key = key;
+    GLsizei written_length = 0;
+    GLenum binary_format = 0;
+    GL_CHECK_ERR_MSG( ctx.glGetProgramBinary(program_id, binary_length, &written_length, &binary_format, binary.get()), return, program_info );
+    header.binary_format = binary_format;
+    header.binary_length = written_length;
+
+    std::string path = shader_cache_path(program_info);
+    FILE* fp = fopen(path.c_str(), "wb");
+    if(fp == NULL)
+    {
+        slogf("warning: failed to open shader cache: `%s`, reason: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+    if(fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(binary.get(), 1, written_length, fp) != static_cast<size_t>(written_length))
+    {
+        slogf("warning: failed to write shader cache: `%s`, reason: %s\n", path.c_str(), strerror(errno));
+    }
+    if(fclose(fp) != 0)
+    {
+        slogf("warning: failed to close shader cache: `%s`, reason: %s\n", path.c_str(), strerror(errno));
+    }
+}
+
+static bool begin_program_compile(shader_program_build& build)
+{
+    GL_CHECK_ERR( build.program_id = ctx.glCreateProgram(), return false );
+
+    build.vertex_id = begin_compile_shader(build.vertex_shader, GL_VERTEX_SHADER, build.vertex_info);
+    if(build.vertex_id == 0)
+    {
+        return false;
+    }
+    build.fragment_id = begin_compile_shader(build.fragment_shader, GL_FRAGMENT_SHADER, build.fragment_info);
+    if(build.fragment_id == 0)
+    {
+        return false;
+    }
+
+    GL_CHECK_ERR_MSG( ctx.glAttachShader(build.program_id, build.vertex_id), return false, build.vertex_info );
+    GL_CHECK_ERR_MSG( ctx.glAttachShader(build.program_id, build.fragment_id), return false, build.fragment_info );
+
+    if(build.use_cache && ctx.glProgramParameteri != NULL)
+    {
+        GL_CHECK_ERR( ctx.glProgramParameteri(build.program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE), return false );
+    }
+
+    //the link is queued after the compiles, so the driver can still work on both shaders in parallel.
+    GL_CHECK_ERR_MSG( ctx.glLinkProgram(build.program_id), return false, build.program_info );
+    return true;
+}
+
+void init_parallel_shader_compile()
+{
+    if(ctx.glMaxShaderCompilerThreadsKHR == NULL)
+    {
+        return;
+    }
+    if(SDL_GL_ExtensionSupported("GL_KHR_parallel_shader_compile") != SDL_TRUE)
+    {
+        return;
+    }
+    //0xFFFFFFFF means the driver picks the number of threads.
+    GL_CHECK( ctx.glMaxShaderCompilerThreadsKHR(0xFFFFFFFF) );
+}
+
+static bool begin_program(shader_program_build& build, const char* program_info, GLchar* vertex_shader, const char* vertex_info, GLchar* fragment_shader, const char* fragment_info)
+{
+    ASSERT(build.program_id == 0 && "build already in use");
+
+    build.program_info = program_info;
+    build.vertex_shader = vertex_shader;
+    build.vertex_info = vertex_info;
+    build.fragment_shader = fragment_shader;
+    build.fragment_info = fragment_info;
+    build.from_cache = false;
+
+#ifdef SHADER_TIMER
+    build.start_time = timer_now();
+#endif
+
+    build.use_cache = shader_cache_supported();
+    if(build.use_cache)
+    {
+        build.cache_key = shader_cache_key(vertex_shader, fragment_shader);
+        build.program_id = begin_cached_program(program_info, build.cache_key);
+        if(build.program_id != 0)
         {
-            break;
+            build.from_cache = true;
+            return true;
         }
+    }
 
-        fragment_id = compile_shader(fragment_shader, GL_FRAGMENT_SHADER, fragment_info);
-        if(fragment_id == 0){
-            break;
-        }
+    if(!begin_program_compile(build))
+    {
+        cancel_shader_program(build);
+        return false;
+    }
+    return true;
+}
+
+void cancel_shader_program(shader_program_build& build)
+{
+    if(build.vertex_id != 0) GL_CHECK_MSG( ctx.glDeleteShader(build.vertex_id), build.vertex_info );
+    if(build.fragment_id != 0) GL_CHECK_MSG( ctx.glDeleteShader(build.fragment_id), build.fragment_info );
+    if(build.program_id != 0) GL_CHECK_MSG( ctx.glDeleteProgram(build.program_id), build.program_info );
+    build.vertex_id = 0;
+    build.fragment_id = 0;
+    build.program_id = 0;
+}
 
-        GL_CHECK_ERR_MSG( ctx.glAttachShader(program_id, vertex_id), break, vertex_info );
-	    GL_CHECK_ERR_MSG( ctx.glAttachShader(program_id, fragment_id), break, fragment_info );
+//this is where the driver will block if the program hasn't finished compiling.
+static GLuint end_program(shader_program_build& build)
+{
+    ASSERT(build.program_id != 0 && "end without a begin");
 
-        GL_CHECK_ERR( ctx.glLinkProgram(program_id), break );
-        GL_CHECK_ERR_MSG( ctx.glDeleteShader(vertex_id), break, vertex_info );
-        vertex_id = 0;
-        GL_CHECK_ERR_MSG( ctx.glDeleteShader(fragment_id), break, fragment_info );
-        fragment_id = 0;
+    GLint link_status;
+    GL_CHECK_ERR( ctx.glGetProgramiv(build.program_id, GL_LINK_STATUS, &link_status), cancel_shader_program(build); return 0 );
 
-        GLint link_status;
-        GL_CHECK_ERR( ctx.glGetProgramiv(program_id, GL_LINK_STATUS, &link_status), break );
-        if (link_status == 0) {
+    if(link_status == 0 && build.from_cache)
+    {
+        //the driver is allowed to reject a binary for any reason (like an update that didn't change the version string).
+        slogf("%s: cached program binary rejected, recompiling\n", build.program_info);
+        cancel_shader_program(build);
+        build.from_cache = false;
+        if(!begin_program_compile(build))
+        {
+            cancel_shader_program(build);
+            return 0;
+        }
+        GL_CHECK_ERR( ctx.glGetProgramiv(build.program_id, GL_LINK_STATUS, &link_status), cancel_shader_program(build); return 0 );
+    }
+
+    if (link_status == 0) {
+        //a compile error is more useful than the link error (which usually just says a shader failed).
+        bool shaders_ok = (build.vertex_id == 0 || check_shader_status(build.vertex_id, build.vertex_info));
+        shaders_ok = (build.fragment_id == 0 || check_shader_status(build.fragment_id, build.fragment_info)) && shaders_ok;
+        if(shaders_ok)
+        {
             GLint log_length;
             GLint infoLogLength;
-            GL_CHECK_ERR( ctx.glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &log_length), break );
+            GL_CHECK_ERR( ctx.glGetProgramiv(build.program_id, GL_INFO_LOG_LENGTH, &log_length), cancel_shader_program(build); return 0 );
             std::unique_ptr<char[]> message(new char[log_length]);
-            GL_CHECK_ERR( ctx.glGetProgramInfoLog(program_id, log_length, &infoLogLength, message.get()), break );
+            GL_CHECK_ERR( ctx.glGetProgramInfoLog(build.program_id, log_length, &infoLogLength, message.get()), cancel_shader_program(build); return 0 );
             if(infoLogLength > 0)
             {
-                serrf("%s:\n%s\n", program_info, message.get());
+                serrf("%s:\n%s\n", build.program_info, message.get());
             }
             else
             {
-                serrf("%s: infoLogLength returned %d\n", program_info, infoLogLength);
+                serrf("%s: infoLogLength returned %d\n", build.program_info, infoLogLength);
             }
-            break;
         }
-        return program_id;
-    } while (false);
-    if(vertex_id != 0) GL_CHECK_MSG( ctx.glDeleteShader(vertex_id), vertex_info );
-    if(fragment_id != 0) GL_CHECK_MSG( ctx.glDeleteShader(fragment_id), fragment_info );
-    GL_CHECK( ctx.glDeleteProgram(program_id) );
-    return 0;
+        cancel_shader_program(build);
+        return 0;
+    }
+
+    //the shaders are attached, so they will be deleted with the program.
+    if(build.vertex_id != 0) GL_CHECK_MSG( ctx.glDeleteShader(build.vertex_id), build.vertex_info );
+    if(build.fragment_id != 0) GL_CHECK_MSG( ctx.glDeleteShader(build.fragment_id), build.fragment_info );
+    build.vertex_id = 0;
+    build.fragment_id = 0;
+
+    if(build.use_cache && !build.from_cache)
+    {
+        save_cached_program(build.program_info, build.program_id, build.cache_key);
+    }
+
+#ifdef SHADER_TIMER
+    slogf("%s %s time: %f\n", build.program_info, (build.from_cache ? "cached program" : "compile"), timer_delta<TIMER_MS>(build.start_time, timer_now()));
+#endif
+
+    //the caller owns the program now.
+    GLuint program_id = build.program_id;
+    build.program_id = 0;
+    return program_id;
 }
 
-GLuint load_basic_shader_program(basic_shader_properties& data)
+bool begin_basic_shader_program(shader_program_build& build)
 {
     static GLchar basic_vertex_shader_str[] =  
 R"(attribute vec4 a_position;
@@ -547,7 +906,12 @@ void main()
 	gl_FragColor = texture2D( s_texture, v_texCoord );
 })";
     
-    GLuint program_id = create_program(__FUNCTION__, basic_vertex_shader_str, "basic_vertex_shader", basic_fragment_shader_str, "basic_fragment_shader");
+    return begin_program(build, "basic_shader_program", basic_vertex_shader_str, "basic_vertex_shader", basic_fragment_shader_str, "basic_fragment_shader");
+}
+
+GLuint end_basic_shader_program(shader_program_build& build, basic_shader_properties& data)
+{
+    GLuint program_id = end_program(build);
     if(program_id == 0)
     {
         return 0;
@@ -586,7 +950,7 @@ void main()
     return program_id;
 }
 
-GLuint load_colorful_shader_program(colorful_shader_properties& data)
+bool begin_colorful_shader_program(shader_program_build& build)
 {
     static GLchar colorful_vertex_shader_str[] =  R"(attribute vec4 a_position;
 attribute vec2 a_texCoord;
@@ -622,7 +986,12 @@ void main()
 	gl_FragColor = texel;
 })";
 
-    GLuint program_id = create_program(__FUNCTION__, colorful_vertex_shader_str, "colorful_vertex_shader", colorful_fragment_shader_str, "colorful_fragment_shader");
+    return begin_program(build, "colorful_shader_program", colorful_vertex_shader_str, "colorful_vertex_shader", colorful_fragment_shader_str, "colorful_fragment_shader");
+}
+
+GLuint end_colorful_shader_program(shader_program_build& build, colorful_shader_properties& data)
+{
+    GLuint program_id = end_program(build);
     if(program_id == 0)
     {
         return 0;
@@ -672,12 +1041,28 @@ void main()
 
     //success
     return program_id;
+}
 
-    
-    
-    return 0;
+
+GLuint load_basic_shader_program(basic_shader_properties& data)
+{
+    shader_program_build build;
+    if(!begin_basic_shader_program(build))
+    {
+        return 0;
+    }
+    return end_basic_shader_program(build, data);
 }
 
+GLuint load_colorful_shader_program(colorful_shader_properties& data)
+{
+    shader_program_build build;
+    if(!begin_colorful_shader_program(build))
+    {
+        return 0;
+    }
+    return end_colorful_shader_program(build, data);
+}
 
 GLuint load_palette_shader_program(palette_shader_properties& data)
 {
@@ -114,6 +114,56 @@ MYNODISCARD GLuint load_texture(RWops* file, GLint filtering, int* w, int* h, bo
 //returns 0 if an error occurred
 MYNODISCARD GLuint load_animated_gif(RWops* file, GLint filtering, int* w, int* h, int* column_size, int* frames, Unique_StbArrayData& delays, bool* rgba = NULL);
 
+//a framebuffer with a RGBA texture, for offscreen rendering.
+struct gl_framebuffer
+{
+    GLuint fbo_id = 0;
+    GLuint texture_id = 0;
+    int width = 0;
+    int height = 0;
+};
+
+//on desktop gl 2.1 this needs GL_ARB_framebuffer_object
+bool framebuffer_supported();
+
+//the framebuffer is unbound when this returns.
+MYNODISCARD bool create_framebuffer(gl_framebuffer& fb, int width, int height, GLint filtering);
+//safe to call on an empty framebuffer.
+void destroy_framebuffer(gl_framebuffer& fb);
+
+//hashes the pixels of the bound framebuffer (fnv1a).
+//this is slow because it waits for the gpu to finish.
+MYNODISCARD bool checksum_framebuffer(int width, int height, Uint64* out);
+
+//building a program is split into a begin and an end, because checking the compile/link status
+//forces the driver to finish compiling, so you should do something else in between (like loading textures).
+//begin will load the program from the binary cache if possible (cv_shader_cache).
+struct shader_program_build
+{
+    const char* program_info = NULL;
+    GLuint program_id = 0;
+    GLuint vertex_id = 0;
+    GLuint fragment_id = 0;
+    //the source is kept in case the cached binary is rejected and it needs to compile.
+    GLchar* vertex_shader = NULL;
+    const char* vertex_info = NULL;
+    GLchar* fragment_shader = NULL;
+    const char* fragment_info = NULL;
+    bool use_cache = false;
+    bool from_cache = false;
+    Uint64 cache_key = 0;
+#ifdef SHADER_TIMER
+    TIMER_U start_time;
+#endif
+};
+
+//call after the context is created, this lets the driver compile on multiple threads (GL_KHR_parallel_shader_compile)
+void init_parallel_shader_compile();
+
+//deletes anything held by the build, safe to call on an empty build.
+//only needed if you don't call end (because of an error).
+void cancel_shader_program(shader_program_build& build);
+
 struct basic_shader_properties
 {
     // Sampler locations
@@ -127,6 +177,11 @@ struct basic_shader_properties
 //returns 0 if an error occurred.
 MYNODISCARD GLuint load_basic_shader_program(basic_shader_properties& data);
 
+//same as load_basic_shader_program, but you can do work in between (see shader_program_build).
+//the build is emptied by end, even if an error occurred.
+MYNODISCARD bool begin_basic_shader_program(shader_program_build& build);
+MYNODISCARD GLuint end_basic_shader_program(shader_program_build& build, basic_shader_properties& data);
+
 struct colorful_shader_properties
 {
     // Sampler locations
@@ -148,6 +203,9 @@ struct colorful_shader_properties
 
 MYNODISCARD GLuint load_colorful_shader_program(colorful_shader_properties& data);
 
+MYNODISCARD bool begin_colorful_shader_program(shader_program_build& build);
+MYNODISCARD GLuint end_colorful_shader_program(shader_program_build& build, colorful_shader_properties& data);
+
 struct palette_shader_properties
 {
     // Sampler locations
@@ -0,0 +1,112 @@
+#include "global.h"
+
+#include "SDL_wrapper.h"
+#include "headless.h"
+
+bool headless_report::open(const char* report_path)
+{
+    ASSERT(report_path != NULL);
+    frame_times.clear();
+    total_draw_calls = 0;
+    has_checksum = false;
+    last_checksum = 0;
+
+    if(report_path[0] == '\0')
+    {
+        return true;
+    }
+
+    report_file = Unique_RWops_OpenFS(report_path, "wb");
+    if(!report_file)
+    {
+        return false;
+    }
+
+    const char header[] = "frame,frame_ms,draw_calls,checksum\n";
+    return write_line(header, sizeof(header) - 1);
+}
+
+bool headless_report::write_line(const char* line, int length)
+{
+    ASSERT(report_file);
+    if(report_file->write(line, 1, length) != static_cast<size_t>(length))
+    {
+        //the RWops should have printed the reason.
+        serrf("%s: failed to write: %s\n", __FUNCTION__, report_file->stream_info);
+        return false;
+    }
+    return true;
+}
+
+bool headless_report::add_frame(const headless_frame& frame)
+{
+    frame_times.push_back(frame.frame_ms);
+    total_draw_calls += frame.draw_calls;
+    if(frame.has_checksum)
+    {
+        has_checksum = true;
+        last_checksum = frame.checksum;
+    }
+
+    if(!report_file)
+    {
+        return true;
+    }
+
+    char buffer[200];
+    int length;
+    if(frame.has_checksum)
+    {
+        length = snprintf(buffer, sizeof(buffer), "%d,%f,%d,%016llx\n", 
+            static_cast<int>(frame_times.size() - 1), frame.frame_ms, frame.draw_calls, static_cast<unsigned long long>(frame.checksum));
+    }
+    else
+    {
+        length = snprintf(buffer, sizeof(buffer), "%d,%f,%d,\n", 
+            static_cast<int>(frame_times.size() - 1), frame.frame_ms, frame.draw_calls);
+    }
+    ASSERT(length > 0 && length < static_cast<int>(sizeof(buffer)));
+    return write_line(buffer, length);
+}
+
+void headless_report::print_summary()
+{
+    if(frame_times.empty())
+    {
+        slog("headless: no frames were rendered\n");
+        return;
+    }
+
+    //the median and 95th are more stable than the average (the first frames are always slow).
+    std::vector<TIMER_RESULT> sorted(frame_times);
+    std::sort(sorted.begin(), sorted.end());
+
+    TIMER_RESULT total_ms = 0;
+    for(TIMER_RESULT ms : frame_times)
+    {
+        total_ms += ms;
+    }
+
+    size_t count = frame_times.size();
+    slogf("headless: frames: %zu, total ms: %f, avg ms: %f, median ms: %f, 95th ms: %f, min ms: %f, max ms: %f, draw calls per frame: %f\n",
+        count, total_ms, total_ms / count, sorted[count / 2], sorted[(count * 95) / 100], 
+        sorted.front(), sorted.back(), static_cast<double>(total_draw_calls) / count);
+    if(has_checksum)
+    {
+        slogf("headless: last checksum: %016llx\n", static_cast<unsigned long long>(last_checksum));
+    }
+}
+
+bool headless_report::close()
+{
+    if(report_file)
+    {
+        report_file.reset();
+        //the RWops can't return an error from the destructor.
+        if(serr_check_error())
+        {
+            return false;
+        }
+    }
+    return true;
+}
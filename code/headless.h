@@ -0,0 +1,32 @@
+#pragma once
+
+//the stats for headless mode (cv_headless), this is for catching performance regressions on CI.
+//the frame time is the cpu time + glFinish, because on llvmpipe the "gpu" is the cpu.
+
+struct headless_frame
+{
+    TIMER_RESULT frame_ms = 0;
+    int draw_calls = 0;
+    bool has_checksum = false;
+    Uint64 checksum = 0;
+};
+
+class headless_report
+{
+public:
+    //writes a csv row per frame into report_path, empty = only print the summary.
+    MYNODISCARD bool open(const char* report_path);
+    MYNODISCARD bool add_frame(const headless_frame& frame);
+    //prints the summary into slog, call before close.
+    void print_summary();
+    MYNODISCARD bool close();
+
+private:
+    Unique_RWops report_file;
+    std::vector<TIMER_RESULT> frame_times;
+    long total_draw_calls = 0;
+    bool has_checksum = false;
+    Uint64 last_checksum = 0;
+
+    MYNODISCARD bool write_line(const char* line, int length);
+};
@@ -4,6 +4,7 @@
 #include "json_wrapper.h"
 
 #include <rapidjson/error/en.h>
+#include <rapidjson/memorystream.h>
 #include <rapidjson/prettywriter.h>
 
 const char* rj_string(const rj::Value& value)
@@ -264,10 +265,21 @@ bool json_context::open(RWops* file)
     context_flags = 0;
 
     char buffer[1024];
-    RWops_JsonReadStream isw(file, buffer, sizeof(buffer));
-
 	// rj::kParseCommentsFlag, rj::UTF8<> is to allow comments
-	if(rj_doc.ParseStream<rj::kParseCommentsFlag, rj::UTF8<>>(isw).HasParseError())
+    bool parse_error;
+    if(file->data() != NULL)
+    {
+        //mapped files are parsed directly, without copying through the buffer.
+        long offset = file->tell();
+        rj::MemoryStream ms(file->data() + offset, file->size() - offset);
+        parse_error = rj_doc.ParseStream<rj::kParseCommentsFlag, rj::UTF8<>>(ms).HasParseError();
+    }
+    else
+    {
+        RWops_JsonReadStream isw(file, buffer, sizeof(buffer));
+        parse_error = rj_doc.ParseStream<rj::kParseCommentsFlag, rj::UTF8<>>(isw).HasParseError();
+    }
+	if(parse_error)
 	{
 		int offset = rj_doc.GetErrorOffset();
 		serrf("Failed to parse json: %s\n"
@@ -35,28 +35,68 @@ static cvar& cv_thread_timeout_ms = register_cvar_value(
 
 
 #include "gl_wrapper.h"
-
-enum{
-	FULLSCREEN_MODE_FIT_TO_SCREEN  = 0,
-	FULLSCREEN_MODE_NATIVE = 1,
-	FULLSCREEN_MODE_STRETCH = 2,
-	FULLSCREEN_MODE_LETTERBOX = 3
-	//TODO: possibly a stretch by multiple of 2 mode, that works like letterbox.
-};
+#include "gl_profiler.h"
+#include "headless.h"
+#include "audio_bench.h"
+#include "render_scale.h"
+#include "frame_stats.h"
+#include "render_queue.h"
+#include "sound_cache.h"
+#include "audio_engine.h"
+#include "batch_read.h"
+#include "asset_pack.h"
+#include "mini_tools.h"
 
 static cvar& cv_vsync = register_cvar_value(
 	"cv_vsync", 1, "vsync setting, 0 (off), 1 (on), -1 (adaptive?)", CVAR_CACHED);
 static cvar& cv_fullscreen = register_cvar_value(
 	"cv_fullscreen", 0, "0 = windowed, 1 = fullscreen", CVAR_CACHED);
 static cvar& cv_fullscreen_mode = register_cvar_value(
-	"cv_fullscreen_mode", 0, "0 = fit to screen, 1 = set hardware resolution, 2 = stretch, 3 = letterbox", CVAR_CACHED);
+	"cv_fullscreen_mode", 0, "0 = fit to screen, 1 = set hardware resolution, 2 = stretch, 3 = letterbox, 4 = integer scale (letterbox with whole numbers)", CVAR_CACHED);
 static cvar& cv_screen_width = register_cvar_value(
 	"cv_screen_width", 640, "if fullscreen, this is ignored in \"fit to screen\" mode", CVAR_CACHED);
 static cvar& cv_screen_height = register_cvar_value(
 	"cv_screen_height", 480, "complements cv_screen_width", CVAR_CACHED);
+static cvar& cv_render_filter = register_cvar_value(
+	"cv_render_filter", 0, "the filter used to scale the scene to the screen, 0 = nearest, 1 = linear", CVAR_DEFAULT);
+static cvar& cv_idle_sleep = register_cvar_value(
+	"cv_idle_sleep", 1, "1 = if nothing on the screen changed, skip the frame and sleep until the next change or input (not in headless mode)", CVAR_DEFAULT);
+static cvar& cv_frame_stats_file = register_cvar_string(
+	"cv_frame_stats_file", "frame_stats.json", "json file with the frame time histogram, written at exit and when F2 is pressed, empty = disabled", CVAR_DEFAULT);
+static cvar& cv_audio_ambient = register_cvar_string(
+	"cv_audio_ambient", "", "ogg files looped under the music, separated by ';'", CVAR_STARTUP);
+static cvar& cv_audio_ambient_gain = register_cvar_value(
+	"cv_audio_ambient_gain", 0.5, "the volume of the ambient loops", CVAR_STARTUP);
+static cvar& cv_audio_device_check_ms = register_cvar_value(
+	"cv_audio_device_check_ms", 1000, "how often to check if the audio device was unplugged, to switch to the default (0 = never)", CVAR_DEFAULT);
+static cvar& cv_audio_click = register_cvar_string(
+	"cv_audio_click", "", "short ogg played when a mouse button is pressed (decoded once into the sound cache)", CVAR_STARTUP);
 static cvar& cv_opengl_debug = register_cvar_value(
 	"cv_opengl_debug", 1, "0 = off, 1 = show detailed opengl errors, 2 = stacktrace per call", CVAR_STARTUP);
 
+static cvar& cv_headless = register_cvar_value(
+	"cv_headless", 0, "1 = render into a framebuffer with a hidden window and a fixed clock, then exit (for benchmarks on CI), music is disabled", CVAR_STARTUP);
+static cvar& cv_audio_bench = register_cvar_value(
+	"cv_audio_bench", 0, "1 = stream the input file into a loopback device as fast as possible, print the decode stats, then exit (no window)", CVAR_STARTUP);
+static cvar& cv_asset_pack = register_cvar_string(
+	"cv_asset_pack", "", "load the images from this pack instead of loose files, empty = loose files", CVAR_STARTUP);
+static cvar& cv_asset_pack_build = register_cvar_string(
+	"cv_asset_pack_build", "", "write cv_asset_pack_files into this pack, then exit (no window)", CVAR_STARTUP);
+static cvar& cv_asset_pack_files = register_cvar_string(
+	"cv_asset_pack_files", "test.png;sexy.gif;spong.gif", "';' separated files for cv_asset_pack_build", CVAR_STARTUP);
+static cvar& cv_asset_pack_compress = register_cvar_value(
+	"cv_asset_pack_compress", 0, "1 = cv_asset_pack_build compresses the files that get smaller (decoded while reading)", CVAR_STARTUP);
+static cvar& cv_headless_frames = register_cvar_value(
+	"cv_headless_frames", 600, "the number of frames to render in headless mode", CVAR_STARTUP);
+static cvar& cv_headless_step_ms = register_cvar_value(
+	"cv_headless_step_ms", 1000.0 / 60.0, "the fixed time step of a frame in headless mode", CVAR_STARTUP);
+static cvar& cv_headless_checksum = register_cvar_value(
+	"cv_headless_checksum", 1, "0 = off, 1 = checksum the last frame, 2 = checksum every frame (slow)", CVAR_STARTUP);
+static cvar& cv_headless_report = register_cvar_string(
+	"cv_headless_report", "headless_report.csv", "csv file with the stats of every frame in headless mode, empty = disabled", CVAR_STARTUP);
+static cvar& cv_headless_video_driver = register_cvar_string(
+	"cv_headless_video_driver", "offscreen", "SDL_VIDEODRIVER to use in headless mode if the environment doesn't set it, empty = default", CVAR_STARTUP);
+
 static SDL_GLContext gl_context;
 
 //from https://github.com/nvMcJohn/apitest
@@ -99,6 +139,10 @@ bool test_json_2();
 bool test_json_3();
 bool test_json_4();
 bool test_json_5();
+bool test_rwops_1();
+bool test_rwops_2();
+bool test_rwops_3();
+bool test_rwops_4();
 
 //could hold an error, but maybe not.
 static const char* startup_settings(int argc, char** argv)
@@ -192,6 +236,64 @@ int main(int argc, char** argv)
 	}
 
 	slog("hellow openal!\n");
+
+	if(cv_audio_bench.get_value() == 1.0)
+	{
+		if(input_file == NULL)
+		{
+			serr("cv_audio_bench requires an ogg file\n");
+		}
+		else if(run_audio_bench(input_file))
+		{
+			return 0;
+		}
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), NULL);
+		return 1;
+	}
+
+	if(!cv_asset_pack_build.get_string().empty())
+	{
+		std::vector<std::string> pack_files;
+		std::string file_list = cv_asset_pack_files.get_string();
+		size_t start = 0;
+		while(start < file_list.size())
+		{
+			size_t end = file_list.find(';', start);
+			if(end == std::string::npos)
+			{
+				end = file_list.size();
+			}
+			if(end != start)
+			{
+				pack_files.push_back(file_list.substr(start, end - start));
+			}
+			start = end + 1;
+		}
+		if(build_asset_pack(cv_asset_pack_build.get_string().c_str(), pack_files, cv_asset_pack_compress.get_value() == 1.0))
+		{
+			return 0;
+		}
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), NULL);
+		return 1;
+	}
+
+	bool headless = (cv_headless.get_value() == 1.0);
+	if(headless)
+	{
+		//CI machines usually don't have a display or an audio device.
+		if(cv_headless_video_driver.get_string()[0] != '\0')
+		{
+			//doesn't overwrite, so you can still pick the driver.
+			SDL_setenv("SDL_VIDEODRIVER", cv_headless_video_driver.get_string().c_str(), 0);
+		}
+		input_file = NULL;
+	}
+
+	//headless mode needs to read back the framebuffer on the same thread.
+	bool render_threaded = false;
+#if !defined(NO_THREADS) && !defined(__EMSCRIPTEN__)
+	render_threaded = (!headless && cv_disable_threads.get_value() == 0.0);
+#endif
     
     //test json stuff
 #if 0
@@ -204,6 +306,10 @@ int main(int argc, char** argv)
     test_json_3();
     test_json_4();
     test_json_5();
+    test_rwops_1();
+    test_rwops_2();
+    test_rwops_3();
+    test_rwops_4();
     
     t2 = timer_now();
     slogf("test time: %f\n", timer_delta<TIMER_MS>(t1,t2));
@@ -218,6 +324,16 @@ int main(int argc, char** argv)
     
 
 
+#if !defined(NO_THREADS) && defined(__GNUC__) && !defined(_WIN32)
+	//xlib needs this before anything else, because the render thread swaps while this thread polls events.
+	if(render_threaded && XInitThreads() == 0)
+	{
+		serr("XInitThreads failed\n");
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), NULL);
+		return 1;
+	}
+#endif
+
 	if(SDL_Init(SDL_INIT_VIDEO) != 0)
 	{
 		serrf("SDL_Init Error: %s", SDL_GetError());
@@ -269,13 +385,15 @@ int main(int argc, char** argv)
 
 	Uint32 sdl_window_flags = cv_fullscreen.get_value() == 0.0 ? 0 
 		: (static_cast<int>(cv_fullscreen_mode.get_value()) == FULLSCREEN_MODE_NATIVE ? SDL_WINDOW_FULLSCREEN : SDL_WINDOW_FULLSCREEN_DESKTOP);
+	//the window only exists to hold the context, everything is drawn into headless_fb.
+	sdl_window_flags = headless ? static_cast<Uint32>(SDL_WINDOW_HIDDEN) : (SDL_WINDOW_SHOWN | sdl_window_flags);
         
     int sdl_window_width = cv_screen_width.get_value();
     int sdl_window_height = cv_screen_height.get_value();
 
 	SDL_Window* window = NULL;
 	window = SDL_CreateWindow("A Window", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 
-                           sdl_window_width, sdl_window_height, SDL_WINDOW_SHOWN | SDL_WINDOW_OPENGL | sdl_window_flags);
+                           sdl_window_width, sdl_window_height, SDL_WINDOW_OPENGL | sdl_window_flags);
 	if(window == NULL)
 	{
 		serrf("SDL_CreateWindow Error: %s", SDL_GetError());
@@ -285,53 +403,117 @@ int main(int argc, char** argv)
 
 	
 
-	if(!InitAL())
+	if(!headless && !InitAL())
 	{
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), window);
 		return 1;
 	}
 
 	
-	AL_OggStream music_stream;
-	
-	if(input_file != NULL){
-		Unique_RWops music = Unique_RWops_OpenFS(input_file, "rb");
-		if(!music)
+	//headless has no openal.
+	bool audio_enabled = (!headless && input_file != NULL);
+	//the cache must outlive the engine, because the engine holds refs.
+	sound_cache sounds;
+	audio_engine audio;
+	int music_handle = 0;
+	sound_ref click_sound;
+
+	if(audio_enabled)
+	{
+		if(!audio.init())
 		{
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), window);
 			return 1;
 		}
 
-		if(!music_stream.open(std::move(music), AL_STREAM_LOOPING))
+		music_handle = audio.play(input_file, AL_STREAM_LOOPING, AUDIO_PRIORITY_MUSIC);
+		if(music_handle == 0)
 		{
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), window);
 			return 1;
 		}
 
-		if(!music_stream.play())
+		//ambient loops are optional, so a missing file is only a warning.
+		std::string ambient_list = cv_audio_ambient.get_string();
+		size_t start = 0;
+		while(start < ambient_list.size())
 		{
-			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), window);
-			return 1;
+			size_t end = ambient_list.find(';', start);
+			if(end == std::string::npos)
+			{
+				end = ambient_list.size();
+			}
+			std::string path = ambient_list.substr(start, end - start);
+			start = end + 1;
+			if(path.empty())
+			{
+				continue;
+			}
+			if(audio.play(path.c_str(), AL_STREAM_LOOPING, AUDIO_PRIORITY_AMBIENT, static_cast<float>(cv_audio_ambient_gain.get_value())) == 0)
+			{
+				slogf("warning: ambient stream failed:\n%s", serr_get_error().c_str());
+			}
+		}
+
+		if(!cv_audio_click.get_string().empty())
+		{
+			click_sound = sounds.load(cv_audio_click.get_string().c_str());
+			if(!click_sound)
+			{
+				slogf("warning: click sound failed:\n%s", serr_get_error().c_str());
+			}
 		}
 	}
 
+	//the streams are decoded on threads, so they keep playing when the main thread stalls.
+	bool audio_threaded = false;
+#if !defined(NO_THREADS) && !defined(__EMSCRIPTEN__)
+	audio_threaded = (audio_enabled && cv_disable_threads.get_value() == 0.0);
+#endif
+
 	
 
 	float colors[3] = {0,0,0};
+	//radians per second
+	const float color_speed[3] = {0.5, 0.7, 0.11};
 
 	//global data
 	int texture_wh[2]{-1,-1};
 	GLuint texture_id = 0;
-	Unique_RWops image_file(Unique_RWops_OpenFS("test.png", "rb"));
-	if(!image_file)
+	//the files are views into the pack, so it is declared first.
+	asset_pack pack;
+	Unique_RWops image_file;
+	Unique_RWops gif_file;
+	if(!cv_asset_pack.get_string().empty())
 	{
-		return 1;
+		if(!pack.open(cv_asset_pack.get_string().c_str()))
+		{
+			return 1;
+		}
+		image_file = pack.open_entry("test.png");
+		gif_file = pack.open_entry("sexy.gif");
+		if(!image_file || !gif_file)
+		{
+			return 1;
+		}
 	}
-
-	Unique_RWops gif_file(Unique_RWops_OpenFS("sexy.gif", "rb"));
-	if(!gif_file)
+	else
 	{
-		return 1;
+		//read together, so the disk latencies overlap.
+		batch_read_request startup_files[2];
+		startup_files[0].path = "test.png";
+		startup_files[1].path = "sexy.gif";
+		batch_read_files(startup_files, std::size(startup_files));
+		for(batch_read_request& request : startup_files)
+		{
+			if(!request.file)
+			{
+				serr(request.error.c_str());
+				return 1;
+			}
+		}
+		image_file = std::move(startup_files[0].file);
+		gif_file = std::move(startup_files[1].file);
 	}
 	
 
@@ -347,6 +529,10 @@ int main(int argc, char** argv)
 	//color shader
 	GLuint color_program_id = 0;
 	colorful_shader_properties color_shader;
+
+	//the shaders compile while the textures load.
+	shader_program_build basic_build;
+	shader_program_build color_build;
 	GLuint color_position_vbo_id = 0;
 	GLuint color_texCoord_vbo_id = 0;
 	GLuint color_colors_vbo_id = 0;
@@ -361,9 +547,95 @@ int main(int argc, char** argv)
 	GLuint gif_position_vbo_id = 0;
 	GLuint gif_texCoord_vbo_id = 0;
 	GLuint gif_vao_id = 0;
+	int gif_current_frame = 0;
+	TIMER_RESULT gif_accum = 0;
+
+	//idle
+	//the longest sleep, just in case the deadline is wrong.
+	#define IDLE_MAX_WAIT_MS 250
+	bool force_redraw = true;
+	Uint64 last_frame_signature = 0;
+	//the deadline is idle_wait_start + idle_wait_ms, the frame time is subtracted before sleeping.
+	TIMER_U idle_wait_start = timer_now();
+	TIMER_RESULT idle_wait_ms = 0;
 
 	GLint check_device_reset = GL_NO_ERROR;
 
+	gl_profiler gpu_profiler;
+	int gpu_pass_clear = -1;
+	int gpu_pass_basic = -1;
+	int gpu_pass_gif = -1;
+	int gpu_pass_colorful = -1;
+	int gpu_pass_present = -1;
+
+	//the scene is drawn into scene_fb if it needs scaling (cv_render_scale / cv_fullscreen_mode).
+	gl_framebuffer scene_fb;
+	GLint scene_filter = 0;
+	render_scale_controller scale_controller;
+	GLuint present_position_vbo_id = 0;
+	GLuint present_vao_id = 0;
+
+	//frame pacing
+	//the samples are added by the render thread, and read by the logic thread.
+	frame_stats frame_timing;
+	//the vsync interval, 0 if vsync is off.
+	double refresh_ms = 0;
+	bool vsync_enabled = false;
+	//render thread
+	TIMER_U last_present;
+	bool last_present_valid = false;
+	//logic thread, the interval after a skipped frame would include the sleep.
+	bool skipped_frame = false;
+
+	//the logic thread (main thread) records the frame, and the render thread draws it.
+	//without threads, the frame is drawn right after it's recorded.
+	render_queue render_frames;
+	//the render thread wakes up this often to pulse the watchdog.
+	#define RENDER_THREAD_WAKE_MS 100
+	//the longest the logic thread waits for the render thread to take a frame.
+	#define RENDER_PICKUP_TIMEOUT_MS 50
+	//the texcoords in gif_texCoord_vbo_id (the first frame is uploaded with the whole atlas).
+	int gif_uploaded_frame = 0;
+#ifndef NO_THREADS
+	debug_thread render_thread;
+	std::atomic_bool render_failed(false);
+	//not a thread, it's only for the pulse, so the render thread can watch the logic thread.
+	debug_thread logic_watch;
+	logic_watch.name = "logic";
+#endif
+
+	//the window could have moved to a different monitor.
+	auto update_refresh_ms = [&]()
+	{
+		refresh_ms = 0;
+		SDL_DisplayMode mode;
+		if(!headless && vsync_enabled && SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0)
+		{
+			refresh_ms = 1000.0 / mode.refresh_rate;
+		}
+	};
+
+	auto dump_frame_stats = [&]()
+	{
+		if(cv_frame_stats_file.get_string().empty())
+		{
+			return;
+		}
+		if(!frame_timing.dump_json(cv_frame_stats_file.get_string().c_str()))
+		{
+			//not worth stopping over.
+			slogf("failed to write frame stats: %s\n", serr_get_error().c_str());
+		}
+	};
+
+	//headless
+	gl_framebuffer headless_fb;
+	headless_report headless_stats;
+	int headless_frame_index = 0;
+	int draw_calls = 0;
+	//a fixed step, so every run renders the same frames.
+	TIMER_U headless_clock = timer_now();
+
 	auto initialize_renderer = [&]
 	{
         //clear previous SDL errors because we depend on checking it.
@@ -418,6 +690,42 @@ int main(int argc, char** argv)
 		{
 			slogf("Warning: SDL_GL_SetSwapInterval(): %s\n", SDL_GetError());
 		}
+		//SDL_GL_GetSwapInterval needs the context, which belongs to the render thread later.
+		vsync_enabled = (SDL_GL_GetSwapInterval() != 0);
+		update_refresh_ms();
+
+		if(headless)
+		{
+			if(!create_framebuffer(headless_fb, sdl_window_width, sdl_window_height, GL_NEAREST))
+			{
+				return false;
+			}
+			//this replaces the window's framebuffer.
+			GL_CHECK_ERR( ctx.glBindFramebuffer(GL_FRAMEBUFFER, headless_fb.fbo_id), return false );
+			GL_CHECK_ERR( ctx.glViewport(0, 0, headless_fb.width, headless_fb.height), return false );
+		}
+
+		init_parallel_shader_compile();
+
+		if(!gpu_profiler.init())
+		{
+			return false;
+		}
+		gpu_pass_clear = gpu_profiler.add_pass("clear");
+		gpu_pass_basic = gpu_profiler.add_pass("basic");
+		gpu_pass_gif = gpu_profiler.add_pass("gif");
+		gpu_pass_colorful = gpu_profiler.add_pass("colorful");
+		gpu_pass_present = gpu_profiler.add_pass("present");
+
+		//start compiling the shaders, the status is checked after the textures are loaded.
+		if(!begin_basic_shader_program(basic_build))
+		{
+			return false;
+		}
+		if(!begin_colorful_shader_program(color_build))
+		{
+			return false;
+		}
 
 		//Set blending to blend
   		GL_CHECK_ERR( ctx.glEnable( GL_BLEND ), return false);
@@ -447,7 +755,7 @@ int main(int argc, char** argv)
 
 
 		//basic shader initialization
-		basic_program_id = load_basic_shader_program(basic_shader);
+		basic_program_id = end_basic_shader_program(basic_build, basic_shader);
 		if(basic_program_id == 0)
 		{
 			return false;
@@ -524,7 +832,7 @@ int main(int argc, char** argv)
 
 		
 		//color shader initialization
-		color_program_id = load_colorful_shader_program(color_shader);
+		color_program_id = end_colorful_shader_program(color_build, color_shader);
 		if(color_program_id == 0)
 		{
 			return false;
@@ -692,6 +1000,51 @@ int main(int argc, char** argv)
 		// GIF END
 		//
 
+		//the quad that draws scene_fb onto the screen, it uses the basic shader.
+		GLfloat present_position_data[VERTEX_COUNT * POSITION_XYZ_SIZE]
+		{
+			-1,-1,0,
+			1,-1,0,
+			-1,1,0,
+			-1,1,0,
+			1,-1,0,
+			1,1,0,
+		};
+
+		GL_CHECK_ERR( ctx.glGenBuffers(1, &present_position_vbo_id), return false);
+		GL_CHECK_ERR( ctx.glBindBuffer(GL_ARRAY_BUFFER, present_position_vbo_id), return false);
+		GL_CHECK_ERR( ctx.glBufferData(GL_ARRAY_BUFFER, sizeof(present_position_data), present_position_data, GL_STATIC_DRAW), return false);
+		GL_SANITY( ctx.glBindBuffer(GL_ARRAY_BUFFER, 0) );
+
+		GL_CHECK_ERR( ctx.glGenVertexArrays(1, &present_vao_id), return false);
+		GL_CHECK_ERR( ctx.glBindVertexArray(present_vao_id), return false);
+
+		GL_CHECK_ERR( ctx.glBindBuffer(GL_ARRAY_BUFFER, present_position_vbo_id), return false);
+		GL_CHECK_ERR( ctx.glVertexAttribPointer(
+			basic_shader.a_position,  // attribute
+			POSITION_XYZ_SIZE,                                // size
+			GL_FLOAT,                         // type
+			GL_FALSE,                         // normalized?
+			0,                // stride
+			0                         // array buffer offset
+		), return false);
+
+		//the texcoords are the same as the basic quad (framebuffers are upside down, so is the position).
+		GL_CHECK_ERR( ctx.glBindBuffer(GL_ARRAY_BUFFER, basic_texCoord_vbo_id), return false);
+		GL_CHECK_ERR( ctx.glVertexAttribPointer(
+			basic_shader.a_texCoord,  // attribute
+			TEXCOORD_ST_SIZE,                                // size
+			GL_FLOAT,                         // type
+			GL_FALSE,                         // normalized?
+			0,                // stride
+			0                          // array buffer offset
+		), return false);
+
+		GL_CHECK_ERR( ctx.glEnableVertexAttribArray(basic_shader.a_position), return false);
+		GL_CHECK_ERR( ctx.glEnableVertexAttribArray(basic_shader.a_texCoord), return false);
+
+		GL_SANITY( ctx.glBindVertexArray(0) );
+
 		if(ctx.glGetError() != GL_NO_ERROR)
 		{
 			//it's just a warning because most likely I am being sloppy with shaders, with missing attributes.
@@ -733,14 +1086,33 @@ int main(int argc, char** argv)
 		SAFE_GL_DELETE_VBO(gif_position_vbo_id);
 		SAFE_GL_DELETE_VBO(gif_texCoord_vbo_id);
 		SAFE_GL_DELETE_VAO(gif_vao_id);
+
+		SAFE_GL_DELETE_VBO(present_position_vbo_id);
+		SAFE_GL_DELETE_VAO(present_vao_id);
 		
 
 		SAFE_GL_DELETE_PROGRAM(color_program_id);
 		SAFE_GL_DELETE_PROGRAM(basic_program_id);
 
+		//in case initialization failed before the programs were finished.
+		cancel_shader_program(color_build);
+		cancel_shader_program(basic_build);
+
 		SAFE_GL_DELETE_TEXTURE(gif_tex_id);
 		SAFE_GL_DELETE_TEXTURE(texture_id);
 
+		if(!gpu_profiler.destroy())
+		{
+			serr("failed to destroy the gpu profiler\n");
+		}
+
+		if(headless_fb.fbo_id != 0 || scene_fb.fbo_id != 0)
+		{
+			GL_CHECK( ctx.glBindFramebuffer(GL_FRAMEBUFFER, 0) );
+		}
+		destroy_framebuffer(scene_fb);
+		destroy_framebuffer(headless_fb);
+
 #undef SAFE_GL_DELETE_TEXTURE
 #undef SAFE_GL_DELETE_PROGRAM
 #undef SAFE_GL_DELETE_VAO
@@ -787,6 +1159,11 @@ int main(int argc, char** argv)
 			loop_state = LOOP_REQUEST_STOP;
             return false;
 			break;
+		case SDL_WINDOWEVENT:
+			//the window could have been resized or uncovered.
+			force_redraw = true;
+			update_refresh_ms();
+			break;
 		case SDL_KEYDOWN:
 			switch(e.key.keysym.sym)
 			{
@@ -816,12 +1193,332 @@ int main(int argc, char** argv)
 						}
 					}
 				}
+				break;
+			case SDLK_F2:
+				dump_frame_stats();
+				break;
             }
 			break;
+		case SDL_MOUSEBUTTONDOWN:
+			if(click_sound)
+			{
+				//losing a click isn't an error.
+				if(audio.play_sound(click_sound) == 0)
+				{
+					slogf("warning: click sound:\n%s", serr_get_error().c_str());
+				}
+			}
+			break;
 		}
 		return true;
 	};
 	
+	//draws a recorded frame, on the render thread (or inline without threads).
+	auto execute_frame = [&](const render_command_list& list) -> bool
+	{
+		TIMER_U render_start = timer_now();
+		draw_calls = 0;
+
+        if(check_device_reset != GL_NO_ERROR && check_device_reset != GL_NO_RESET_NOTIFICATION)
+		{
+			GLenum status;
+			GL_RUNTIME( status = ctx.glGetGraphicsResetStatus() );
+			switch(status)
+			{
+			case GL_NO_ERROR:
+				//good.
+				break;
+			case GL_GUILTY_CONTEXT_RESET:
+				serr("GL_GUILTY_CONTEXT_RESET\n");
+				return false;
+			case GL_INNOCENT_CONTEXT_RESET:
+				//NOTE: I could try to restore all the opengl context, but it is pure suffering.
+				serr("GL_INNOCENT_CONTEXT_RESET\n");
+				return false;
+			case GL_UNKNOWN_CONTEXT_RESET:
+				serr("GL_UNKNOWN_CONTEXT_RESET\n");
+				return false;
+			default:
+				slogf("warning: glGetGraphicsResetStatus returned unknown: (0x%.8x)\n", status);
+				check_device_reset = GL_NO_ERROR; //just in case of spam
+			}
+		}
+
+		const render_layout& layout = list.layout;
+		int drawable_w = list.drawable_w;
+		int drawable_h = list.drawable_h;
+		GLuint present_fbo_id = headless ? headless_fb.fbo_id : 0;
+
+		bool use_scene_fb = layout.needs_scaling(drawable_w, drawable_h);
+		if(use_scene_fb && !framebuffer_supported())
+		{
+			static bool warn_once = false;
+			if(!warn_once)
+			{
+				slog("warning: render scale and letterboxing require framebuffer objects\n");
+				warn_once = true;
+			}
+			use_scene_fb = false;
+		}
+
+		if(use_scene_fb)
+		{
+			GLint filter = list.filter;
+			if(scene_fb.width != layout.scene_w || scene_fb.height != layout.scene_h || scene_filter != filter)
+			{
+				destroy_framebuffer(scene_fb);
+				if(!create_framebuffer(scene_fb, layout.scene_w, layout.scene_h, filter))
+				{
+					return false;
+				}
+				scene_filter = filter;
+			}
+			GL_RUNTIME( ctx.glBindFramebuffer(GL_FRAMEBUFFER, scene_fb.fbo_id) );
+			GL_RUNTIME( ctx.glViewport(0, 0, layout.scene_w, layout.scene_h) );
+		}
+		else
+		{
+			if(framebuffer_supported())
+			{
+				GL_RUNTIME( ctx.glBindFramebuffer(GL_FRAMEBUFFER, present_fbo_id) );
+			}
+			GL_RUNTIME( ctx.glViewport(0, 0, drawable_w, drawable_h) );
+		}
+
+		GL_RUNTIME( ctx.glClearColor(list.clear_color[0], list.clear_color[1], list.clear_color[2], 1) );
+
+		gpu_profiler.begin_pass(gpu_pass_clear);
+		GL_RUNTIME( ctx.glClear(GL_COLOR_BUFFER_BIT) );
+		gpu_profiler.end_pass();
+
+		for(const render_command& command : list.commands)
+		{
+			switch(command.type)
+			{
+			case RCMD_DRAW_BASIC:
+				gpu_profiler.begin_pass(gpu_pass_basic);
+
+				//use shader
+				GL_RUNTIME( ctx.glUseProgram(basic_program_id) );
+				GL_RUNTIME( ctx.glActiveTexture(GL_TEXTURE0) );
+		  		GL_RUNTIME( ctx.glBindTexture(GL_TEXTURE_2D, texture_id) );
+
+				//shader uniforms
+				GL_RUNTIME( ctx.glUniform1i(basic_shader.s_texture, 0) );
+
+				//set attribues and draw
+				GL_RUNTIME( ctx.glBindVertexArray(basic_vao_id) );
+				GL_RUNTIME( ctx.glDrawArrays(GL_TRIANGLES, 0, VERTEX_COUNT) );
+				++draw_calls;
+		
+				//cleanup program (TODO: but you can cache these values for the next draw)
+				GL_SANITY( ctx.glBindVertexArray(0) );
+				GL_SANITY( ctx.glBindTexture(GL_TEXTURE_2D, 0) );
+				GL_SANITY( ctx.glUseProgram(0) );
+
+				gpu_profiler.end_pass();
+				break;
+			case RCMD_DRAW_GIF:
+			{
+				//
+				//render gif
+				//
+				gpu_profiler.begin_pass(gpu_pass_gif);
+				//upload changes
+				int gif_frame = command.arg;
+				if(gif_frame != gif_uploaded_frame)
+				{
+					gif_uploaded_frame = gif_frame;
+					GLfloat atlas_x = gif_frame / gif_column_size;
+					GLfloat atlas_y = gif_frame % gif_column_size;
+					GLfloat atlas_width = SDL_ceilf((GLfloat)gif_frame_count / (GLfloat)gif_column_size);
+					GLfloat atlas_height = gif_column_size;
+					GLfloat minx = atlas_x / atlas_width;
+					GLfloat miny = atlas_y / atlas_height;
+					GLfloat maxx = (atlas_x + 1.0) / atlas_width;
+					GLfloat maxy = (atlas_y + 1.0) / atlas_height;
+
+					GLfloat common_texCoord_data[VERTEX_COUNT * 2];
+					common_texCoord_data[0] = minx;
+					common_texCoord_data[1] = miny;
+
+					common_texCoord_data[2] = maxx;
+					common_texCoord_data[3] = miny;
+
+					common_texCoord_data[4] = minx;
+					common_texCoord_data[5] = maxy;
+
+					common_texCoord_data[6] = minx;
+					common_texCoord_data[7] = maxy;
+
+					common_texCoord_data[8] = maxx;
+					common_texCoord_data[9] = miny;
+
+					common_texCoord_data[10] = maxx;
+					common_texCoord_data[11] = maxy;
+
+					GL_RUNTIME( ctx.glBindBuffer(GL_ARRAY_BUFFER, gif_texCoord_vbo_id) );
+					GL_RUNTIME( ctx.glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(common_texCoord_data), common_texCoord_data) );
+					GL_SANITY( ctx.glBindBuffer(GL_ARRAY_BUFFER, 0) );
+				}
+
+				GL_RUNTIME( ctx.glUseProgram(basic_program_id) );
+				GL_RUNTIME( ctx.glActiveTexture(GL_TEXTURE0) );
+				GL_RUNTIME( ctx.glBindTexture(GL_TEXTURE_2D, gif_tex_id) );
+				GL_RUNTIME( ctx.glUniform1i(basic_shader.s_texture, 0) );
+				GL_RUNTIME( ctx.glBindVertexArray(gif_vao_id) );
+				GL_RUNTIME( ctx.glDrawArrays(GL_TRIANGLES, 0, VERTEX_COUNT) );
+				++draw_calls;
+		
+				//cleanup program (TODO: but you can cache these values for the next draw)
+				GL_SANITY( ctx.glBindVertexArray(0) );
+				GL_SANITY( ctx.glBindTexture(GL_TEXTURE_2D, 0) );
+				GL_SANITY( ctx.glUseProgram(0) );
+
+				gpu_profiler.end_pass();
+				break;
+			}
+			case RCMD_DRAW_COLORFUL:
+				//
+				// COLOR SHADER
+				//
+				gpu_profiler.begin_pass(gpu_pass_colorful);
+
+				//use shader
+				GL_RUNTIME( ctx.glUseProgram(color_program_id) );
+				GL_RUNTIME( ctx.glActiveTexture(GL_TEXTURE0) );
+		  		GL_RUNTIME( ctx.glBindTexture(GL_TEXTURE_2D, texture_id) );
+
+				//shader uniforms
+				GL_RUNTIME( ctx.glUniform1i(color_shader.s_texture, 0) );
+
+				//set attribues and draw
+				GL_RUNTIME( ctx.glBindVertexArray(color_vao_id) );
+				GL_RUNTIME( ctx.glDrawArrays(GL_TRIANGLES, 0, VERTEX_COUNT) );
+				++draw_calls;
+				GL_SANITY( ctx.glBindVertexArray(0) );
+
+				//cleanup program
+				GL_SANITY( ctx.glBindTexture(GL_TEXTURE_2D, 0) );
+				GL_SANITY( ctx.glUseProgram(0) );
+
+				gpu_profiler.end_pass();
+				break;
+			default:
+				ASSERT(false && "unknown render command");
+			}
+		}
+
+		//
+		// PRESENT
+		//
+		if(use_scene_fb)
+		{
+			gpu_profiler.begin_pass(gpu_pass_present);
+			GL_RUNTIME( ctx.glBindFramebuffer(GL_FRAMEBUFFER, present_fbo_id) );
+			GL_RUNTIME( ctx.glViewport(0, 0, drawable_w, drawable_h) );
+			if(layout.viewport_w != drawable_w || layout.viewport_h != drawable_h)
+			{
+				//the bars
+				GL_RUNTIME( ctx.glClearColor(0, 0, 0, 1) );
+				GL_RUNTIME( ctx.glClear(GL_COLOR_BUFFER_BIT) );
+			}
+			GL_RUNTIME( ctx.glViewport(layout.viewport_x, layout.viewport_y, layout.viewport_w, layout.viewport_h) );
+
+			//the alpha of the scene isn't 1, so don't blend.
+			GL_RUNTIME( ctx.glDisable(GL_BLEND) );
+			GL_RUNTIME( ctx.glUseProgram(basic_program_id) );
+			GL_RUNTIME( ctx.glActiveTexture(GL_TEXTURE0) );
+			GL_RUNTIME( ctx.glBindTexture(GL_TEXTURE_2D, scene_fb.texture_id) );
+			GL_RUNTIME( ctx.glUniform1i(basic_shader.s_texture, 0) );
+			GL_RUNTIME( ctx.glBindVertexArray(present_vao_id) );
+			GL_RUNTIME( ctx.glDrawArrays(GL_TRIANGLES, 0, VERTEX_COUNT) );
+			++draw_calls;
+
+			GL_SANITY( ctx.glBindVertexArray(0) );
+			GL_SANITY( ctx.glBindTexture(GL_TEXTURE_2D, 0) );
+			GL_SANITY( ctx.glUseProgram(0) );
+			GL_RUNTIME( ctx.glEnable(GL_BLEND) );
+			gpu_profiler.end_pass();
+		}
+
+		gpu_profiler.end_frame();
+
+		//this is before the swap, because the swap waits for vsync.
+		TIMER_RESULT render_ms = timer_delta<TIMER_MS>(render_start, timer_now());
+		if(gpu_profiler.is_active())
+		{
+			render_ms = std::max(render_ms, gpu_profiler.get_total_ms());
+		}
+		render_frames.finish_frame(render_ms);
+
+		TIMER_U swap_start = timer_now();
+		if(headless)
+		{
+			//glFinish so the frame time includes the rendering.
+			GL_RUNTIME( ctx.glFinish() );
+		}
+		else
+		{
+			SDL_GL_SwapWindow(window);
+		}
+
+		TIMER_U swap_end = timer_now();
+		frame_sample sample;
+		sample.cpu_ms = static_cast<float>(timer_delta<TIMER_MS>(render_start, swap_start));
+		sample.swap_ms = static_cast<float>(timer_delta<TIMER_MS>(swap_start, swap_end));
+		if(last_present_valid && list.continuous)
+		{
+			sample.present_interval_ms = static_cast<float>(timer_delta<TIMER_MS>(last_present, swap_end));
+		}
+		frame_timing.add_sample(sample);
+		last_present = swap_end;
+		last_present_valid = true;
+
+        //check if any GL_RUNTIME errors were made.
+		if(serr_check_error())
+        {
+            serr("note: this should be an opengl error.'\n");
+            return false;
+        }
+		return true;
+	};
+
+#ifndef NO_THREADS
+	auto render_thread_main = [&](debug_thread* context)
+	{
+		debug_thread_raii context_raii(context);
+		if(SDL_GL_MakeCurrent(window, gl_context) != 0)
+		{
+			serrf("SDL_GL_MakeCurrent Error: %s\n", SDL_GetError());
+			render_failed = true;
+			return;
+		}
+		bool warn_once = false;
+		while(!render_frames.is_stopped())
+		{
+			context->pulse();
+			//nothing else can watch the logic thread.
+			if(!warn_once && !logic_watch.check_pulse_ms(static_cast<int>(cv_thread_timeout_ms.get_value())))
+			{
+				//it's printed, but it's not an error of this thread.
+				(void)serr_get_error();
+				warn_once = true;
+			}
+			//wakes up to pulse even if the logic thread is idle.
+			const render_command_list* list = render_frames.wait_for_frame(RENDER_THREAD_WAKE_MS);
+			if(list != NULL && !execute_frame(*list))
+			{
+				render_failed = true;
+				break;
+			}
+		}
+		//give the context back for destroy_renderer.
+		SDL_GL_MakeCurrent(window, NULL);
+	};
+#endif
+
+
     //the void* parameter is for emscripten.
 	auto app_update = [&](void* = NULL)
 	{
@@ -834,6 +1531,28 @@ int main(int argc, char** argv)
         }
 #endif
 
+		TIMER_U frame_start = timer_now();
+#ifndef NO_THREADS
+		logic_watch.pulse();
+		if(render_threaded)
+		{
+			if(render_failed.load())
+			{
+				//the errors are read after joining.
+				loop_state = LOOP_ERROR;
+				return;
+			}
+			static bool warn_once = false;
+			if(!warn_once && !render_thread.check_pulse_ms(static_cast<int>(cv_thread_timeout_ms.get_value())))
+			{
+				//if the thread timed out, thats bad, but maybe theres a possibility that it is working
+				serr("Warning this is only shown once.\n");
+				SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), NULL);
+				warn_once = true;
+			}
+		}
+#endif
+
         SDL_Event e;
         while(SDL_PollEvent(&e) != 0)
         {
@@ -841,62 +1560,85 @@ int main(int argc, char** argv)
                 return;
         }
 
-		if(input_file != NULL)
+		frame_timing.update(refresh_ms);
+
+		//the render time of the last frame that finished.
+		TIMER_RESULT last_render_ms;
+		if(render_frames.pop_render_ms(&last_render_ms))
+		{
+			scale_controller.add_frame(last_render_ms);
+		}
+
+#ifndef NO_THREADS
+		if(audio_threaded)
 		{
-			if(!music_stream.update())
+			static bool warn_once = false;
+			if(!warn_once && !audio.check_pulse_ms(static_cast<int>(cv_thread_timeout_ms.get_value())))
 			{
+				serr("Warning this is only shown once.\n");
+				SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), NULL);
+				warn_once = true;
+			}
+		}
+#endif
+		if(audio_enabled)
+		{
+			//check before update() releases the stream.
+			if(!audio.is_playing(music_handle))
+			{
+				serrf("the music stopped:\n%s", audio.get_error(music_handle).c_str());
                 loop_state = LOOP_ERROR;
 				return;
 			}
-			if(!music_stream.is_playing())
+			if(!audio.update())
 			{
                 loop_state = LOOP_ERROR;
 				return;
 			}
+			static TIMER_U device_check_time = timer_now();
+			if(cv_audio_device_check_ms.get_value() > 0 &&
+			   timer_delta<TIMER_MS>(device_check_time, timer_now()) >= cv_audio_device_check_ms.get_value())
+			{
+				device_check_time = timer_now();
+				if(!AL_IsDeviceConnected())
+				{
+					slog("the audio device was disconnected\n");
+					if(!audio.switch_device(NULL, &sounds))
+					{
+						//a failed reopen keeps the old device, so try again later.
+						if(!AL_CanReopenDevice())
+						{
+							loop_state = LOOP_ERROR;
+							return;
+						}
+						slogf("warning: %s", serr_get_error().c_str());
+					}
+				}
+			}
 		}
 
-        if(check_device_reset != GL_NO_ERROR && check_device_reset != GL_NO_RESET_NOTIFICATION)
+		TIMER_U current_time;
+		if(headless)
 		{
-			GLenum status;
-			GL_RUNTIME( status = ctx.glGetGraphicsResetStatus() );
-			switch(status)
-			{
-			case GL_NO_ERROR:
-				//good.
-				break;
-			case GL_GUILTY_CONTEXT_RESET:
-				serr("GL_GUILTY_CONTEXT_RESET\n");
-                loop_state = LOOP_ERROR;
-				return;
-			case GL_INNOCENT_CONTEXT_RESET:
-				//NOTE: I could try to restore all the opengl context, but it is pure suffering.
-				serr("GL_INNOCENT_CONTEXT_RESET\n");
-                loop_state = LOOP_ERROR;
-				return;
-			case GL_UNKNOWN_CONTEXT_RESET:
-				serr("GL_UNKNOWN_CONTEXT_RESET\n");
-                loop_state = LOOP_ERROR;
-				return;
-			default:
-				slogf("warning: glGetGraphicsResetStatus returned unknown: (0x%.8x)\n", status);
-				check_device_reset = GL_NO_ERROR; //just in case of spam
-			}
+			headless_clock += std::chrono::duration_cast<TIMER_U::duration>(
+				std::chrono::duration<TIMER_RESULT, std::milli>(cv_headless_step_ms.get_value()));
+			current_time = headless_clock;
+		}
+		else
+		{
+			current_time = timer_now();
 		}
 
-		static TIMER_U color_time = timer_now();
-		TIMER_U current_time = timer_now();
+		static TIMER_U color_time = current_time;
 		TIMER_RESULT color_delta = timer_delta<TIMER_SEC>(color_time, current_time);
 		color_time = current_time;
 
-		colors[0] = colors[0] + (0.5 * color_delta);
-		colors[1] = colors[1] + (0.7 * color_delta);
-		colors[2] = colors[2] + (0.11 * color_delta);
-
-		GL_RUNTIME( ctx.glClearColor(
-			(SDL_sinf(colors[0]) + 1.0) / 2.0,  
-			(SDL_sinf(colors[1]) + 1.0) / 2.0, 
-			(SDL_sinf(colors[2]) + 1.0) / 2.0, 
-			1));
+		GLfloat clear_color[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			colors[i] = colors[i] + (color_speed[i] * color_delta);
+			clear_color[i] = (SDL_sinf(colors[i]) + 1.0) / 2.0;
+		}
 
 #if 0
 //I can test if vsync works with this, it causes rips because of sudden change of color.
@@ -910,32 +1652,12 @@ int main(int argc, char** argv)
 #endif
 
 		
-		GL_RUNTIME( ctx.glClear(GL_COLOR_BUFFER_BIT) );
-
-		//use shader
-		GL_RUNTIME( ctx.glUseProgram(basic_program_id) );
-		GL_RUNTIME( ctx.glActiveTexture(GL_TEXTURE0) );
-  		GL_RUNTIME( ctx.glBindTexture(GL_TEXTURE_2D, texture_id) );
-
-		//shader uniforms
-		GL_RUNTIME( ctx.glUniform1i(basic_shader.s_texture, 0) );
-
-		//set attribues and draw
-		GL_RUNTIME( ctx.glBindVertexArray(basic_vao_id) );
-		GL_RUNTIME( ctx.glDrawArrays(GL_TRIANGLES, 0, VERTEX_COUNT) );
-		
-		//cleanup program (TODO: but you can cache these values for the next draw)
-		GL_SANITY( ctx.glBindVertexArray(0) );
-		GL_SANITY( ctx.glBindTexture(GL_TEXTURE_2D, 0) );
-
 		//
-		//render gif
+		//animate gif
 		//
 		if(gif_delays[0] != 0){	//if this is not an animated image
 			static TIMER_U gif_animation_timer = current_time;
-			static int gif_current_frame = 0;
             static TIMER_RESULT gif_loop_total_ms = 0;
-            static TIMER_RESULT gif_accum = 0;
             
             //calculate the total loop length
             if(gif_loop_total_ms == 0)
@@ -956,101 +1678,154 @@ int main(int argc, char** argv)
             
             gif_accum += gif_delta_time;
             
-            int gif_new_frame = gif_current_frame;
-            
             //NOTE: I am unsure if I should use > or >=, it wouldn't cause a desync but it will cause an offset.
-            for(;gif_accum > gif_delays[gif_new_frame]; gif_accum -= gif_delays[gif_new_frame])
+            //the render side uploads the texcoords when the frame changes.
+            for(;gif_accum > gif_delays[gif_current_frame]; gif_accum -= gif_delays[gif_current_frame])
             {
-                gif_new_frame = (gif_new_frame+1) % gif_frame_count;
+                gif_current_frame = (gif_current_frame+1) % gif_frame_count;
             }
-            
-            //upload changes
-			if(gif_new_frame != gif_current_frame)
-            {
-                gif_current_frame = gif_new_frame;
-                
-				GLfloat atlas_x = gif_current_frame / gif_column_size;
-				GLfloat atlas_y = gif_current_frame % gif_column_size;
-				GLfloat atlas_width = SDL_ceilf((GLfloat)gif_frame_count / (GLfloat)gif_column_size);
-				GLfloat atlas_height = gif_column_size;
-				GLfloat minx = atlas_x / atlas_width;
-				GLfloat miny = atlas_y / atlas_height;
-				GLfloat maxx = (atlas_x + 1.0) / atlas_width;
-				GLfloat maxy = (atlas_y + 1.0) / atlas_height;
-                
-				GLfloat common_texCoord_data[VERTEX_COUNT * 2];
-				common_texCoord_data[0] = minx;
-				common_texCoord_data[1] = miny;
-
-				common_texCoord_data[2] = maxx;
-				common_texCoord_data[3] = miny;
-
-				common_texCoord_data[4] = minx;
-				common_texCoord_data[5] = maxy;
-
-				common_texCoord_data[6] = minx;
-				common_texCoord_data[7] = maxy;
-
-				common_texCoord_data[8] = maxx;
-				common_texCoord_data[9] = miny;
-
-				common_texCoord_data[10] = maxx;
-				common_texCoord_data[11] = maxy;
-
-				GL_RUNTIME( ctx.glBindBuffer(GL_ARRAY_BUFFER, gif_texCoord_vbo_id) );
-				GL_RUNTIME( ctx.glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(common_texCoord_data), common_texCoord_data) );
-                GL_SANITY( ctx.glBindBuffer(GL_ARRAY_BUFFER, 0) );
-			}
 		}
-		
-
-
-		GL_RUNTIME( ctx.glBindTexture(GL_TEXTURE_2D, gif_tex_id) );
-		GL_RUNTIME( ctx.glBindVertexArray(gif_vao_id) );
-		GL_RUNTIME( ctx.glDrawArrays(GL_TRIANGLES, 0, VERTEX_COUNT) );
-		
-		//cleanup program (TODO: but you can cache these values for the next draw)
-		GL_SANITY( ctx.glBindVertexArray(0) );
-		GL_SANITY( ctx.glBindTexture(GL_TEXTURE_2D, 0) );
-
-
-		GL_SANITY( ctx.glUseProgram(0) );
 
+		//the layout of the scene on the screen.
+		int drawable_w;
+		int drawable_h;
+		if(headless)
+		{
+			drawable_w = headless_fb.width;
+			drawable_h = headless_fb.height;
+		}
+		else
+		{
+			SDL_GL_GetDrawableSize(window, &drawable_w, &drawable_h);
+		}
+		//the fullscreen modes only make sense in fullscreen.
+		int layout_mode = (headless || cv_fullscreen.get_value() == 0.0) 
+			? FULLSCREEN_MODE_FIT_TO_SCREEN : static_cast<int>(cv_fullscreen_mode.get_value());
+		render_layout layout = calc_render_layout(drawable_w, drawable_h, 
+			std::max(static_cast<int>(cv_screen_width.get_value()), 1), std::max(static_cast<int>(cv_screen_height.get_value()), 1), 
+			layout_mode, scale_controller.get_scale());
+		GLint filter = (cv_render_filter.get_value() == 0.0) ? GL_NEAREST : GL_LINEAR;
+
+		if(!headless && cv_idle_sleep.get_value() == 1.0)
+		{
+			//the clear color is stored as 8 bits, so the small changes are invisible.
+			Uint8 clear_rgb[3];
+			for(int i = 0; i < 3; ++i)
+			{
+				clear_rgb[i] = static_cast<Uint8>(clear_color[i] * 255.0f + 0.5f);
+			}
+			Uint64 signature = fnv1a_hash(clear_rgb, sizeof(clear_rgb));
+			signature = fnv1a_hash(&gif_current_frame, sizeof(gif_current_frame), signature);
+			signature = fnv1a_hash(&layout, sizeof(layout), signature);
+			signature = fnv1a_hash(&filter, sizeof(filter), signature);
+
+			//find the next time something on the screen changes.
+			TIMER_RESULT wait_ms = IDLE_MAX_WAIT_MS;
+			if(gif_delays[0] != 0)
+			{
+				wait_ms = std::min(wait_ms, gif_delays[gif_current_frame] - gif_accum);
+			}
+			for(int i = 0; i < 3; ++i)
+			{
+				//the rate of the 8 bit value per ms, and the distance to the next rounding point.
+				double slope = SDL_cos(colors[i]);
+				double rate = SDL_fabs(slope) * color_speed[i] * 0.5 * 255.0 / 1000.0;
+				double value = clear_color[i] * 255.0;
+				double distance = (slope >= 0) ? (SDL_floor(value + 0.5) + 0.5 - value) : (value - (SDL_floor(value + 0.5) - 0.5));
+				if(rate > 0)
+				{
+					wait_ms = std::min(wait_ms, distance / rate);
+				}
+			}
+			if(audio_enabled && !audio_threaded)
+			{
+				wait_ms = std::min(wait_ms, audio.get_wait_ms());
+			}
+			idle_wait_start = timer_now();
+			idle_wait_ms = std::max(wait_ms, TIMER_RESULT(0));
 
-		//
-		// COLOR SHADER
-		//
+			bool skip_frame = (!force_redraw && signature == last_frame_signature);
+			force_redraw = false;
+			last_frame_signature = signature;
+			if(skip_frame)
+			{
+				skipped_frame = true;
+				return;
+			}
+		}
+		else
+		{
+			idle_wait_ms = 0;
+		}
 
-		//use shader
-		GL_RUNTIME( ctx.glUseProgram(color_program_id) );
-		GL_RUNTIME( ctx.glActiveTexture(GL_TEXTURE0) );
-  		GL_RUNTIME( ctx.glBindTexture(GL_TEXTURE_2D, texture_id) );
+		render_command_list& list = render_frames.begin_record();
+		for(int i = 0; i < 3; ++i)
+		{
+			list.clear_color[i] = clear_color[i];
+		}
+		list.layout = layout;
+		list.drawable_w = drawable_w;
+		list.drawable_h = drawable_h;
+		list.filter = filter;
+		list.continuous = !skipped_frame;
+		skipped_frame = false;
+		list.push(RCMD_DRAW_BASIC);
+		list.push(RCMD_DRAW_GIF, gif_current_frame);
+		list.push(RCMD_DRAW_COLORFUL);
+
+		if(render_threaded)
+		{
+			render_frames.submit();
+			//this lets the logic run one frame ahead, but it won't wait behind a stuck driver.
+			(void)render_frames.wait_for_pickup(RENDER_PICKUP_TIMEOUT_MS);
+			return;
+		}
 
-		//shader uniforms
-		GL_RUNTIME( ctx.glUniform1i(color_shader.s_texture, 0) );
+		if(!execute_frame(list))
+		{
+			loop_state = LOOP_ERROR;
+			return;
+		}
 
-		//set attribues and draw
-		GL_RUNTIME( ctx.glBindVertexArray(color_vao_id) );
-		GL_RUNTIME( ctx.glDrawArrays(GL_TRIANGLES, 0, VERTEX_COUNT) );
-		GL_SANITY( ctx.glBindVertexArray(0) );
+		if(headless)
+		{
+			headless_frame frame;
+			frame.frame_ms = timer_delta<TIMER_MS>(frame_start, timer_now());
+			frame.draw_calls = draw_calls;
+
+			++headless_frame_index;
+			bool last_frame = (headless_frame_index >= static_cast<int>(cv_headless_frames.get_value()));
+			int checksum_mode = static_cast<int>(cv_headless_checksum.get_value());
+			if(checksum_mode == 2 || (checksum_mode == 1 && last_frame))
+			{
+				if(!checksum_framebuffer(headless_fb.width, headless_fb.height, &frame.checksum))
+				{
+					loop_state = LOOP_ERROR;
+					return;
+				}
+				frame.has_checksum = true;
+			}
 
-		//cleanup program
-		GL_SANITY( ctx.glBindTexture(GL_TEXTURE_2D, 0) );
-		GL_SANITY( ctx.glUseProgram(0) );
-        
-		SDL_GL_SwapWindow(window);
-        
-        //check if any GL_RUNTIME errors were made.
-		if(serr_check_error())
-        {
-            serr("note: this should be an opengl error.'\n");
-            loop_state = LOOP_ERROR;
-            return;
-        }
+			if(!headless_stats.add_frame(frame))
+			{
+				loop_state = LOOP_ERROR;
+				return;
+			}
+			if(last_frame)
+			{
+				loop_state = LOOP_REQUEST_STOP;
+			}
+		}
 
 		return;
 	};
     
+	if(headless && !headless_stats.open(cv_headless_report.get_string().c_str()))
+	{
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), window);
+		return 1;
+	}
+
     //before starting the loop, check for uncaught errors.
 	if(serr_check_error())
 	{
@@ -1058,16 +1833,99 @@ int main(int argc, char** argv)
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error (Uncaptured)", serr_get_error().c_str(), NULL);
 	}
 	
+#ifndef NO_THREADS
+	if(render_threaded)
+	{
+		//the render thread owns the context until it's joined.
+		if(SDL_GL_MakeCurrent(window, NULL) != 0)
+		{
+			serrf("SDL_GL_MakeCurrent Error: %s\n", SDL_GetError());
+			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), window);
+			return 1;
+		}
+		logic_watch.pulse();
+		render_thread.run("render", render_thread_main);
+	}
+#endif
+	//started right before the loop, so the early returns don't need to join it.
+	if(audio_enabled)
+	{
+		audio.start(audio_threaded);
+	}
+
 #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop(app_update, 0, 1);
 #else
     while(loop_state == LOOP_RUNNING)
     {
         app_update();
+        if(loop_state == LOOP_RUNNING && idle_wait_ms > 0)
+        {
+            //round down, waking up early is fine.
+            int remaining_ms = static_cast<int>(idle_wait_ms - timer_delta<TIMER_MS>(idle_wait_start, timer_now()));
+            if(remaining_ms > 0)
+            {
+                //wakes up early if there is input (the event stays in the queue).
+                SDL_WaitEventTimeout(NULL, remaining_ms);
+            }
+        }
     }
 #endif
 
 	ASSERT(loop_state != LOOP_RUNNING);
+
+#ifndef NO_THREADS
+	if(render_threaded)
+	{
+		render_frames.stop();
+		//join the thread (this will print a stacktrace on windows of the timed out thread)
+		if(!render_thread.timed_join(static_cast<int>(cv_thread_timeout_ms.get_value())))
+		{
+			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Critical Error", serr_get_error().c_str(), window);
+			//there is no graceful way of continuing.
+			exit(1);
+		}
+		std::string errors = render_thread.get_errors();
+		if(!errors.empty())
+		{
+			serr(errors.c_str());
+			loop_state = LOOP_ERROR;
+		}
+		//destroy_renderer needs the context.
+		if(SDL_GL_MakeCurrent(window, gl_context) != 0)
+		{
+			serrf("SDL_GL_MakeCurrent Error: %s\n", SDL_GetError());
+		}
+	}
+
+#endif
+
+	if(audio_enabled)
+	{
+		if(!audio.join(static_cast<int>(cv_thread_timeout_ms.get_value())))
+		{
+			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Critical Error", serr_get_error().c_str(), window);
+			//there is no graceful way of continuing.
+			exit(1);
+		}
+		std::string errors = audio.get_errors();
+		if(!errors.empty())
+		{
+			serr(errors.c_str());
+			loop_state = LOOP_ERROR;
+		}
+	}
+
+	dump_frame_stats();
+
+	if(headless)
+	{
+		headless_stats.print_summary();
+		if(!headless_stats.close())
+		{
+			loop_state = LOOP_ERROR;
+		}
+	}
 	
 	if(loop_state == LOOP_ERROR && !serr_check_error())
 	{
@@ -1079,19 +1937,33 @@ int main(int argc, char** argv)
 		serrf("\nExited normally but errors were made...\n");
 	}
 
+	//a non zero exit code is for scripts (like headless mode on CI).
+	int exit_code = 0;
+
 	if(serr_check_error())
 	{
+		exit_code = 1;
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), NULL);
 	}
 	
     if(!destroy_renderer())
     {
+		exit_code = 1;
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), window);
     }
 
 
-	if(!music_stream.close())
+	if(!audio.destroy())
+	{
+		exit_code = 1;
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), window);
+	}
+
+	click_sound.reset();
+	sounds.print_stats();
+	if(!sounds.destroy())
 	{
+		exit_code = 1;
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", serr_get_error().c_str(), window);
 	}
 
@@ -1110,6 +1982,7 @@ int main(int argc, char** argv)
 	{
 		serrf("\nUncaught Error Check, Function: %s, File: %s, Line: %d\n", __FUNCTION__, __FILE__, __LINE__);
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error (Uncaptured)", serr_get_error().c_str(), NULL);
+		exit_code = 1;
 	}
-	return 0;
+	return exit_code;
 }
@@ -15,6 +15,21 @@ inline std::string better_to_string(double t, double scale = 0)
 	return str;
 }
 
+// FNV-1a, this is not a good hash for hash tables or security,
+// but it is small and the result is stable between runs (for cache keys and checksums).
+// you can chain calls by passing the previous result as the seed.
+#define FNV1A_SEED 14695981039346656037ULL
+inline Uint64 fnv1a_hash(const void* data, size_t size, Uint64 hash = FNV1A_SEED)
+{
+	const unsigned char* cursor = static_cast<const unsigned char*>(data);
+	for(size_t i = 0; i < size; ++i)
+	{
+		hash ^= cursor[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
 // a note about the event listener / observer system, I could have made this into one macro
 // but the reason why I didn't is because I don't want the macro to do too much,
 // and because you can define a listener in a header, and observer in a source file.
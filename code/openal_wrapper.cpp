@@ -1,9 +1,18 @@
 #include "global.h"
 #include "SDL_wrapper.h"
 #include "cvar.h"
+#include "mini_tools.h"
 
 #include "openal_wrapper.h"
 
+// for indexing the pages.
+#include <ogg/ogg.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AL_WRAPPER_USE_SSE2
+#endif
+
 /*
 On windows (maybe linux) OpenAL will not switch the default audio device 
 when the default is lost or a new default is found.
@@ -16,13 +25,74 @@ and set -DALSOFT_EXAMPLES=OFF
 */
 
 
-// TODO (dootsie): implement the openal callback API
-// because it lowers latency and only buffers as much as needed, and for SDL when I drag the window the IO thread freezes.
+// note the freezing when dragging the window is fixed by the audio_engine workers
 // TODO (dootsie): AL_OggStream could support positional playback
 static cvar& cv_openal_buffercount = register_cvar_value(
 	"cv_openal_buffercount", 8, "audio stream buffers", CVAR_DEFAULT);
 static cvar& cv_openal_buffersize = register_cvar_value(
 	"cv_openal_buffersize", 8192, "audio stream buffer size", CVAR_DEFAULT);
+static cvar& cv_openal_decode_ahead = register_cvar_value(
+	"cv_openal_decode_ahead", 4, "the number of buffers worth of audio decoded ahead of the buffers", CVAR_DEFAULT);
+static cvar& cv_openal_float = register_cvar_value(
+	"cv_openal_float", 1, "1 = decode to float samples if AL_EXT_float32 is supported, 0 = 16 bit", CVAR_DEFAULT);
+static cvar& cv_openal_adaptive = register_cvar_value(
+	"cv_openal_adaptive", 1, "1 = grow the stream buffers on underruns, and shrink them when the queue never runs low (not with the callback)", CVAR_DEFAULT);
+static cvar& cv_openal_buffercount_min = register_cvar_value(
+	"cv_openal_buffercount_min", 3, "the least buffers cv_openal_adaptive will queue", CVAR_DEFAULT);
+static cvar& cv_openal_buffercount_max = register_cvar_value(
+	"cv_openal_buffercount_max", 16, "the most buffers cv_openal_adaptive will queue (this many are allocated)", CVAR_DEFAULT);
+static cvar& cv_openal_buffersize_min = register_cvar_value(
+	"cv_openal_buffersize_min", 2048, "the smallest buffer size cv_openal_adaptive will use", CVAR_DEFAULT);
+static cvar& cv_openal_buffersize_max = register_cvar_value(
+	"cv_openal_buffersize_max", 32768, "the largest buffer size cv_openal_adaptive will use", CVAR_DEFAULT);
+static cvar& cv_openal_adapt_ms = register_cvar_value(
+	"cv_openal_adapt_ms", 2000, "how long the underruns and the queue depth are measured before adapting", CVAR_DEFAULT);
+static cvar& cv_openal_seek_index = register_cvar_value(
+	"cv_openal_seek_index", 1, "0 = seeks bisect the file, 1 = index the ogg pages on the first seek (reads the whole file once), 2 = also cache the index in a <file>.seekidx file", CVAR_DEFAULT);
+static cvar& cv_openal_latency = register_cvar_value(
+	"cv_openal_latency", 1, "1 = measure how far ahead the streams are, the update time, and the device latency (AL_SOFT_source_latency)", CVAR_DEFAULT);
+static cvar& cv_openal_latency_log_ms = register_cvar_value(
+	"cv_openal_latency_log_ms", 0, "how often every stream prints its latency, 0 = never (cv_audio_stats_ms also shows it)", CVAR_DEFAULT);
+static cvar& cv_openal_callback = register_cvar_value(
+	"cv_openal_callback", 1, "1 = let openal pull the audio with AL_SOFT_callback_buffer if supported (lower latency and memory), 0 = queue buffers", CVAR_DEFAULT);
+
+#ifdef AL_SOFT_callback_buffer
+static LPALBUFFERCALLBACKSOFT p_alBufferCallbackSOFT = NULL;
+#endif
+
+#ifdef AL_SOFT_source_latency
+static LPALGETSOURCEDVSOFT p_alGetSourcedvSOFT = NULL;
+#endif
+
+// needs a current context.
+static bool load_source_latency()
+{
+#ifdef AL_SOFT_source_latency
+	if(alIsExtensionPresent("AL_SOFT_source_latency") != AL_TRUE)
+	{
+		return false;
+	}
+	p_alGetSourcedvSOFT = reinterpret_cast<LPALGETSOURCEDVSOFT>(alGetProcAddress("alGetSourcedvSOFT"));
+	return p_alGetSourcedvSOFT != NULL;
+#else
+	return false;
+#endif
+}
+
+// needs a current context.
+static bool load_buffer_callback()
+{
+#ifdef AL_SOFT_callback_buffer
+	if(cv_openal_callback.get_value() == 0.0 || alIsExtensionPresent("AL_SOFT_callback_buffer") != AL_TRUE)
+	{
+		return false;
+	}
+	p_alBufferCallbackSOFT = reinterpret_cast<LPALBUFFERCALLBACKSOFT>(alGetProcAddress("alBufferCallbackSOFT"));
+	return p_alBufferCallbackSOFT != NULL;
+#else
+	return false;
+#endif
+}
 
 static size_t oggRWopsRead(void* ptr, size_t size, size_t nmemb, void* datasource)
 {
@@ -39,6 +109,34 @@ static long oggRWopsTell(void* datasource)
 	return static_cast<RWops*>(datasource)->tell();
 }
 
+// ov_read_float gives a buffer per channel, openal wants them interleaved.
+static void interleave_float(float* out, float** pcm, int channels, long frames)
+{
+	if(channels == 1)
+	{
+		memcpy(out, pcm[0], frames * sizeof(float));
+		return;
+	}
+	ASSERT(channels == 2);
+	const float* left = pcm[0];
+	const float* right = pcm[1];
+	long i = 0;
+#ifdef AL_WRAPPER_USE_SSE2
+	for(; i + 4 <= frames; i += 4)
+	{
+		__m128 l = _mm_loadu_ps(left + i);
+		__m128 r = _mm_loadu_ps(right + i);
+		_mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(l, r));
+	}
+#endif
+	for(; i < frames; ++i)
+	{
+		out[i * 2] = left[i];
+		out[i * 2 + 1] = right[i];
+	}
+}
+
 static ov_callbacks g_oggRWopsCallbacks
 {
 	// read
@@ -175,6 +273,139 @@ bool InitAL(const char* device_name)
 	return success;
 }
 
+#ifdef ALC_SOFT_loopback
+static LPALCRENDERSAMPLESSOFT p_alcRenderSamplesSOFT = NULL;
+#endif
+
+bool InitAL_Loopback(int frequency)
+{
+#ifdef ALC_SOFT_loopback
+	if(alcIsExtensionPresent(NULL, "ALC_SOFT_loopback") != ALC_TRUE)
+	{
+		serr("InitAL_Loopback: ALC_SOFT_loopback is not supported.\n");
+		return false;
+	}
+	LPALCLOOPBACKOPENDEVICESOFT p_alcLoopbackOpenDeviceSOFT =
+		reinterpret_cast<LPALCLOOPBACKOPENDEVICESOFT>(alcGetProcAddress(NULL, "alcLoopbackOpenDeviceSOFT"));
+	LPALCISRENDERFORMATSUPPORTEDSOFT p_alcIsRenderFormatSupportedSOFT =
+		reinterpret_cast<LPALCISRENDERFORMATSUPPORTEDSOFT>(alcGetProcAddress(NULL, "alcIsRenderFormatSupportedSOFT"));
+	p_alcRenderSamplesSOFT = reinterpret_cast<LPALCRENDERSAMPLESSOFT>(alcGetProcAddress(NULL, "alcRenderSamplesSOFT"));
+	if(p_alcLoopbackOpenDeviceSOFT == NULL || p_alcIsRenderFormatSupportedSOFT == NULL || p_alcRenderSamplesSOFT == NULL)
+	{
+		serr("InitAL_Loopback: failed to load the ALC_SOFT_loopback functions.\n");
+		return false;
+	}
+
+	ALCdevice* device = p_alcLoopbackOpenDeviceSOFT(NULL);
+	if(device == NULL)
+	{
+		serr("InitAL_Loopback: failed to open the loopback device.\n");
+		return false;
+	}
+	if(p_alcIsRenderFormatSupportedSOFT(device, frequency, ALC_STEREO_SOFT, ALC_FLOAT_SOFT) != ALC_TRUE)
+	{
+		serrf("InitAL_Loopback: stereo float at %d hz is not supported.\n", frequency);
+		alcCloseDevice(device);
+		return false;
+	}
+	const ALCint attribs[] = {
+		ALC_FORMAT_CHANNELS_SOFT, ALC_STEREO_SOFT,
+		ALC_FORMAT_TYPE_SOFT, ALC_FLOAT_SOFT,
+		ALC_FREQUENCY, frequency,
+		0
+	};
+	ALCcontext* ctx = alcCreateContext(device, attribs);
+	if(ctx == NULL)
+	{
+		serr("InitAL_Loopback: alcCreateContext failed.\n");
+		alcCloseDevice(device);
+		return false;
+	}
+	if(alcMakeContextCurrent(ctx) == ALC_FALSE)
+	{
+		serr("InitAL_Loopback: alcMakeContextCurrent failed.\n");
+		alcDestroyContext(ctx);
+		alcCloseDevice(device);
+		return false;
+	}
+	return true;
+#else
+	(void)frequency;
+	serr("InitAL_Loopback: compiled without ALC_SOFT_loopback.\n");
+	return false;
+#endif
+}
+
+void AL_RenderLoopback(float* buffer, int frames)
+{
+#ifdef ALC_SOFT_loopback
+	ASSERT(p_alcRenderSamplesSOFT != NULL && "InitAL_Loopback");
+	ALCcontext* ctx = alcGetCurrentContext();
+	ASSERT(ctx != NULL);
+	p_alcRenderSamplesSOFT(alcGetContextsDevice(ctx), buffer, frames);
+#else
+	(void)buffer;
+	(void)frames;
+	ASSERT(false && "InitAL_Loopback");
+#endif
+}
+
+bool AL_CanReopenDevice()
+{
+#ifdef ALC_SOFT_reopen_device
+	ALCcontext* ctx = alcGetCurrentContext();
+	return ctx != NULL && alcIsExtensionPresent(alcGetContextsDevice(ctx), "ALC_SOFT_reopen_device") == ALC_TRUE;
+#else
+	return false;
+#endif
+}
+
+bool AL_ReopenDevice(const char* device_name)
+{
+#ifdef ALC_SOFT_reopen_device
+	ALCcontext* ctx = alcGetCurrentContext();
+	ASSERT(ctx != NULL);
+	ALCdevice* device = alcGetContextsDevice(ctx);
+	LPALCREOPENDEVICESOFT p_alcReopenDeviceSOFT =
+		reinterpret_cast<LPALCREOPENDEVICESOFT>(alcGetProcAddress(device, "alcReopenDeviceSOFT"));
+	if(p_alcReopenDeviceSOFT == NULL)
+	{
+		serr("AL_ReopenDevice: failed to load alcReopenDeviceSOFT.\n");
+		return false;
+	}
+	if(p_alcReopenDeviceSOFT(device, device_name, NULL) == ALC_FALSE)
+	{
+		// the old device is still open if this fails.
+		return alcerr("AL_ReopenDevice: failed to reopen the device", device);
+	}
+	return true;
+#else
+	(void)device_name;
+	ASSERT(false && "AL_CanReopenDevice");
+	return false;
+#endif
+}
+
+bool AL_IsDeviceConnected()
+{
+	ALCcontext* ctx = alcGetCurrentContext();
+	if(ctx == NULL)
+	{
+		// it can't be known, and switching devices wouldn't fix a missing context.
+		return true;
+	}
+#ifdef ALC_EXT_disconnect
+	ALCdevice* device = alcGetContextsDevice(ctx);
+	if(alcIsExtensionPresent(device, "ALC_EXT_disconnect") == ALC_TRUE)
+	{
+		ALCint connected = ALC_TRUE;
+		alcGetIntegerv(device, ALC_CONNECTED, 1, &connected);
+		return connected != ALC_FALSE;
+	}
+#endif
+	return true;
+}
+
 void CloseAL()
 {
 	ALCcontext* ctx = alcGetCurrentContext();
@@ -188,7 +419,45 @@ void CloseAL()
 	}
 }
 
-bool AL_OggStream::open(Unique_RWops&& file_, int flags_)
+static bool adaptive_enabled()
+{
+	return cv_openal_adaptive.get_value() != 0.0;
+}
+
+static int get_buffer_allocate_count()
+{
+	int count = static_cast<int>(cv_openal_buffercount.get_value());
+	if(adaptive_enabled())
+	{
+		// the extra buffers are allocated upfront, they're cheap without data.
+		count = std::max(count, static_cast<int>(cv_openal_buffercount_max.get_value()));
+	}
+	return std::max(count, 1);
+}
+
+int AL_OggStream::get_voice_buffer_count()
+{
+	return load_buffer_callback() ? 1 : get_buffer_allocate_count();
+}
+
+size_t AL_OggStream::get_memory_bytes() const
+{
+	size_t total = loop_head.capacity();
+	if(pcm_ring)
+	{
+		total += pcm_ring->get_capacity();
+	}
+	// decode_buf + temp_buf
+	total += static_cast<size_t>(buffer_alloc_bytes) * (use_callback ? 1 : 2);
+	// the callback buffer doesn't hold any data.
+	if(!use_callback)
+	{
+		total += static_cast<size_t>(buffer_alloc_bytes) * buffer_count;
+	}
+	return total;
+}
+
+bool AL_OggStream::open(Unique_RWops&& file_, int flags_, const AL_StreamVoice* voice)
 {
 	ASSERT(file_);
 
@@ -203,47 +472,7 @@ bool AL_OggStream::open(Unique_RWops&& file_, int flags_)
 
 	// initialize open al buffer and source id's ---------------
 
-	if(!buffers)
-	{
-		buffer_count = static_cast<int>(cv_openal_buffercount.get_value());
-		buffers.reset(new ALuint[buffer_count]);
-		alGenBuffers(buffer_count, buffers.get());
-		if(!internal_check_al_err(__FUNCTION__, "Could not create buffers"))
-		{
-			buffers.reset();
-			return false;
-		}
-	}
-	if(source_id == 0)
-	{
-		alGenSources(1, &source_id);
-		if(!internal_check_al_err(__FUNCTION__, "Could not create source"))
-		{
-			return false;
-		}
-		// this makes the source follow the listener, because stereo is pointless in 3D space
-		alSource3i(source_id, AL_POSITION, 0, 0, -1);
-		alSourcei(source_id, AL_SOURCE_RELATIVE, AL_TRUE);
-		// this shouldn't make a difference to the sound, but it is a hint that distance isn't used.
-		alSourcei(source_id, AL_ROLLOFF_FACTOR, 0);
-		if(!internal_check_al_err(__FUNCTION__, "Could not set source parameters"))
-		{
-			return false;
-		}
-	}
-	else
-	{
-		// Rewind the source position, and stops playback.
-		alSourceRewind(source_id);
-		// zero is a valid buffer ID, and it is used to clear the queue.
-		alSourcei(source_id, AL_BUFFER, 0);
-		if(!internal_check_al_err(__FUNCTION__, "Could not rewind source"))
-		{
-			return false;
-		}
-	}
-
-	if(!internal_check_al_err(__FUNCTION__, "Could not set looping"))
+	if(!internal_create_al(__FUNCTION__, voice))
 	{
 		return false;
 	}
@@ -256,6 +485,9 @@ bool AL_OggStream::open(Unique_RWops&& file_, int flags_)
 		alformat = 0;
 	}
 
+	seek_index.clear();
+	seek_index_tried = false;
+
 	//don't use file, since I only move the file if opening is successful
 	int ov_ret = ov_open_callbacks(file_.get(), &vf, NULL, 0, g_oggRWopsCallbacks);
 	if(ov_ret != 0)
@@ -267,13 +499,24 @@ bool AL_OggStream::open(Unique_RWops&& file_, int flags_)
 	vorbis_info* vi = ov_info(&vf, -1);
 	ASSERT(vi != NULL && "ov_info"); // should be impossible.
 
+	// the granules of chained files restart for every link, so they are never indexed.
+	if(ov_streams(&vf) != 1)
+	{
+		seek_index_tried = true;
+	}
+
 	// open AL supports more channel formats,
 	// ambisonic b-format seems interesting since it can be converted to 5.1/7.1 but vorbis doesn't
 	// support it, opus does (AL_EXT_BFORMAT & AL_SOFT_bformat_ex).
+	use_float = false;
+#ifdef AL_EXT_float32
+	use_float = (cv_openal_float.get_value() == 1.0 && alIsExtensionPresent("AL_EXT_float32") == AL_TRUE);
+#endif
+	sample_bytes = use_float ? sizeof(float) : sizeof(short);
 	if(vi->channels == 1)
-		alformat = AL_FORMAT_MONO16;
+		alformat = use_float ? AL_FORMAT_MONO_FLOAT32 : AL_FORMAT_MONO16;
 	else if(vi->channels == 2)
-		alformat = AL_FORMAT_STEREO16;
+		alformat = use_float ? AL_FORMAT_STEREO_FLOAT32 : AL_FORMAT_STEREO16;
 	else
 	{
 		serrf("AL_OggStream::%s Error: unsupported channel count in `%s` (got: %d)\n",
@@ -288,12 +531,55 @@ bool AL_OggStream::open(Unique_RWops&& file_, int flags_)
 	// this is quite silly, since I ignore that the real size of the buffer if you open a smaller
 	// channel stream. but mono channels are pretty rare, and the cost of allocating the buffer is
 	// negligible.
-	int new_buffer_size = static_cast<int>(cv_openal_buffersize.get_value()) * vi->channels;
-	if(buffer_size < new_buffer_size)
+	adaptive = (!use_callback && adaptive_enabled());
+	int frames = static_cast<int>(cv_openal_buffersize.get_value());
+	active_buffers = std::min(static_cast<int>(cv_openal_buffercount.get_value()), buffer_count);
+	if(adaptive)
+	{
+		// the settings are the starting point.
+		frames = std::clamp(frames, static_cast<int>(cv_openal_buffersize_min.get_value()),
+							static_cast<int>(cv_openal_buffersize_max.get_value()));
+		active_buffers = std::clamp(active_buffers, static_cast<int>(cv_openal_buffercount_min.get_value()), buffer_count);
+	}
+	active_buffers = std::max(active_buffers, 1);
+	int new_buffer_size = frames * vi->channels;
+	int new_buffer_bytes = new_buffer_size * sample_bytes;
+	if(buffer_alloc_bytes < new_buffer_bytes)
 	{
-		temp_buf.reset(new short[new_buffer_size]);
+		// the callback reads the ring directly.
+		if(!use_callback)
+		{
+			temp_buf.reset(new char[new_buffer_bytes]);
+		}
+		decode_buf.reset(new char[new_buffer_bytes]);
+		buffer_alloc_bytes = new_buffer_bytes;
 	}
 	buffer_size = new_buffer_size;
+	sample_rate = vi->rate;
+	channels = vi->channels;
+
+	size_t ring_size = static_cast<size_t>(new_buffer_bytes) * std::max(static_cast<int>(cv_openal_decode_ahead.get_value()), 1);
+	if(!pcm_ring || pcm_ring->get_capacity() < ring_size)
+	{
+		pcm_ring.reset(new spsc_ring<char>(ring_size));
+	}
+	pcm_ring->clear();
+	decode_eof = false;
+	loop_head_target = ring_size;
+	internal_reset_loop_head();
+
+	// the source was rewinded, so every buffer is free.
+	free_buffers.assign(buffers.get(), buffers.get() + buffer_count);
+	queued_buffers = 0;
+	queued_bytes = 0;
+	has_source_latency = load_source_latency();
+	latency_log_time = timer_now();
+	telemetry = AL_StreamTelemetry();
+	telemetry.buffer_count = active_buffers;
+	telemetry.buffer_frames = buffer_size / channels;
+	adapt_time = timer_now();
+	adapt_underruns = 0;
+	adapt_min_queued = active_buffers;
 
 	if(!internal_fill_buffers(__FUNCTION__))
 	{
@@ -308,6 +594,128 @@ bool AL_OggStream::open(Unique_RWops&& file_, int flags_)
 	return true;
 }
 
+bool AL_OggStream::internal_create_al(const char* func, const AL_StreamVoice* voice)
+{
+	if(voice != NULL)
+	{
+		ASSERT(voice->source != 0 && voice->buffers != NULL && voice->buffer_count > 0);
+		// switching from owned objects would leak them.
+		ASSERT(source_id == 0 || shared_voice);
+		// the callback only works with a single buffer.
+		use_callback = (voice->buffer_count == 1 && load_buffer_callback());
+		buffer_count = voice->buffer_count;
+		buffers.reset(new ALuint[buffer_count]);
+		std::copy(voice->buffers, voice->buffers + buffer_count, buffers.get());
+		// this will be rewinded below.
+		source_id = voice->source;
+		shared_voice = true;
+	}
+	else if(!buffers)
+	{
+		// the callback only needs 1 buffer.
+		use_callback = load_buffer_callback();
+		buffer_count = use_callback ? 1 : get_buffer_allocate_count();
+		buffers.reset(new ALuint[buffer_count]);
+		alGenBuffers(buffer_count, buffers.get());
+		if(!internal_check_al_err(func, "Could not create buffers"))
+		{
+			buffers.reset();
+			return false;
+		}
+	}
+	if(source_id == 0)
+	{
+		alGenSources(1, &source_id);
+		if(!internal_check_al_err(func, "Could not create source"))
+		{
+			return false;
+		}
+		// this makes the source follow the listener, because stereo is pointless in 3D space
+		alSource3i(source_id, AL_POSITION, 0, 0, -1);
+		alSourcei(source_id, AL_SOURCE_RELATIVE, AL_TRUE);
+		// this shouldn't make a difference to the sound, but it is a hint that distance isn't used.
+		alSourcei(source_id, AL_ROLLOFF_FACTOR, 0);
+		if(!internal_check_al_err(func, "Could not set source parameters"))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		// Rewind the source position, and stops playback.
+		alSourceRewind(source_id);
+		// zero is a valid buffer ID, and it is used to clear the queue.
+		alSourcei(source_id, AL_BUFFER, 0);
+		if(!internal_check_al_err(func, "Could not rewind source"))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool AL_OggStream::detach_device()
+{
+	ASSERT(!error_state);
+
+	// currently_playing is kept for attach_device.
+	// stopping first, so the callback isn't called anymore.
+	alSourceRewind(source_id);
+	alSourcei(source_id, AL_BUFFER, 0);
+	if(!shared_voice)
+	{
+		alDeleteSources(1, &source_id);
+		alDeleteBuffers(buffer_count, buffers.get());
+	}
+	if(!internal_check_al_err(__FUNCTION__, "Failed to release the device objects"))
+	{
+		return false;
+	}
+	source_id = 0;
+	buffers.reset();
+	shared_voice = false;
+
+	// the queued audio is lost with the device, but the ring and the decoder keep their place.
+	free_buffers.clear();
+	queued_buffers = 0;
+	queued_bytes = 0;
+	return true;
+}
+
+bool AL_OggStream::attach_device(const AL_StreamVoice* voice)
+{
+	ASSERT(!error_state);
+	ASSERT(source_id == 0 && "detach_device first");
+
+	bool had_callback = use_callback;
+	if(!internal_create_al(__FUNCTION__, voice))
+	{
+		return false;
+	}
+	if(use_callback != had_callback)
+	{
+		// the new voice doesn't match, the ring is fine either way.
+		if(!use_callback && !temp_buf)
+		{
+			temp_buf.reset(new char[buffer_alloc_bytes]);
+		}
+		adaptive = (!use_callback && adaptive_enabled());
+	}
+	active_buffers = std::min(std::max(active_buffers, 1), buffer_count);
+
+	free_buffers.assign(buffers.get(), buffers.get() + buffer_count);
+	if(!internal_fill_buffers(__FUNCTION__))
+	{
+		return false;
+	}
+	if(currently_playing)
+	{
+		return play();
+	}
+	return true;
+}
+
 bool AL_OggStream::close()
 {
 	bool success = true;
@@ -327,6 +735,20 @@ bool AL_OggStream::close()
 		alformat = 0;
 	}
 
+	if(shared_voice)
+	{
+		// the owner will reuse the source, so just leave it empty.
+		alSourceRewind(source_id);
+		alSourcei(source_id, AL_BUFFER, 0);
+		if(!internal_check_al_err(__FUNCTION__, "Failed to detach shared source"))
+		{
+			success = false;
+		}
+		source_id = 0;
+		buffers.reset();
+		shared_voice = false;
+	}
+
 	if(source_id != 0)
 	{
 		alDeleteSources(1, &source_id);
@@ -360,6 +782,62 @@ bool AL_OggStream::close()
 }
 
 bool AL_OggStream::update()
+{
+	if(cv_openal_latency.get_value() == 0.0)
+	{
+		return internal_update();
+	}
+	TIMER_U start = timer_now();
+	if(!internal_update())
+	{
+		return false;
+	}
+	return internal_measure_latency(__FUNCTION__, timer_delta<TIMER_MS>(start, timer_now()));
+}
+
+bool AL_OggStream::internal_measure_latency(const char* func, double update_ms)
+{
+	telemetry.update_ms = update_ms;
+	telemetry.update_max_ms = std::max(telemetry.update_max_ms, update_ms);
+
+	double bytes_per_ms = static_cast<double>(sample_rate) * channels * sample_bytes / 1000.0;
+	telemetry.ring_ms = pcm_ring->size() / bytes_per_ms;
+	telemetry.queued_buffers = queued_buffers;
+	telemetry.queued_ms = 0;
+	if(!use_callback)
+	{
+		// the offset is from the start of the oldest queued buffer.
+		ALint played = 0;
+		alGetSourcei(source_id, AL_BYTE_OFFSET, &played);
+		telemetry.queued_ms = std::max<Sint64>(static_cast<Sint64>(queued_bytes) - played, 0) / bytes_per_ms;
+	}
+#ifdef AL_SOFT_source_latency
+	if(has_source_latency)
+	{
+		// the offset, and the time until the next sample reaches the speaker.
+		ALdouble values[2] = {0, 0};
+		p_alGetSourcedvSOFT(source_id, AL_SEC_OFFSET_LATENCY_SOFT, values);
+		telemetry.device_latency_ms = values[1] * 1000.0;
+	}
+#endif
+	if(!internal_check_al_err(func, "Error measuring latency"))
+	{
+		return false;
+	}
+
+	double log_ms = cv_openal_latency_log_ms.get_value();
+	if(log_ms > 0 && timer_delta<TIMER_MS>(latency_log_time, timer_now()) >= log_ms)
+	{
+		latency_log_time = timer_now();
+		slogf("audio `%s`: ahead: %.1f ms (ring: %.1f, queued: %.1f in %d buffers), device latency: %.1f ms, update: %.3f ms (max: %.3f)\n",
+			  file_info, telemetry.ring_ms + telemetry.queued_ms, telemetry.ring_ms, telemetry.queued_ms,
+			  telemetry.queued_buffers, telemetry.device_latency_ms, telemetry.update_ms, telemetry.update_max_ms);
+		telemetry.update_max_ms = 0;
+	}
+	return true;
+}
+
+bool AL_OggStream::internal_update()
 {
 	ASSERT(!error_state);
 
@@ -372,42 +850,68 @@ bool AL_OggStream::update()
 		return false;
 	}
 
-	vorbis_info* vi = ov_info(&vf, -1);
-
-	// TODO (dootsie): looping AL_OggStream doesn't perfect loop
-	while(processed-- > 0)
+	if(use_callback)
 	{
-		ALuint bufid;
-		alSourceUnqueueBuffers(source_id, 1, &bufid);
-		if(!internal_check_al_err(__FUNCTION__, "Error unqueue buffer data"))
+		// the mixer reads the ring, this only keeps it full.
+		if(!internal_decode(__FUNCTION__))
 		{
 			return false;
 		}
-
-		int current_section; // unused
-		int bytes_read;
-
-		bytes_read = ov_read(&vf, (char*)temp_buf.get(), buffer_size * sizeof(short), 0, 2, 1,
-							 &current_section);
-		if(bytes_read == 0)
+		if(state == AL_STOPPED && decode_eof.load() && pcm_ring->size() == 0)
 		{
-			// eof
-			break;
+			// the callback only stops the source at eof.
+			currently_playing = false;
 		}
-		if(bytes_read < 0)
+		else if(state != AL_PLAYING && state != AL_PAUSED)
 		{
-			internal_print_ov_err(__FUNCTION__, bytes_read, "Could not read file");
-			return false;
+			if(!play())
+			{
+				return false;
+			}
 		}
+		else
+		{
+			currently_playing = true;
+		}
+		return true;
+	}
 
-		
-		alBufferData(bufid, alformat, temp_buf.get(), (ALsizei)bytes_read, (ALsizei)vi->rate);
-		alSourceQueueBuffers(source_id, 1, &bufid);
-
-		if(!internal_check_al_err(__FUNCTION__, "Error buffering data"))
+	while(processed-- > 0)
+	{
+		ALuint bufid;
+		alSourceUnqueueBuffers(source_id, 1, &bufid);
+		if(!internal_check_al_err(__FUNCTION__, "Error unqueue buffer data"))
+		{
+			return false;
+		}
+		ALint size = 0;
+		alGetBufferi(bufid, AL_SIZE, &size);
+		if(!internal_check_al_err(__FUNCTION__, "Error getting buffer size"))
 		{
 			return false;
 		}
+		free_buffers.push_back(bufid);
+		--queued_buffers;
+		queued_bytes -= size;
+	}
+
+	if(state == AL_PLAYING)
+	{
+		// the lowest the queue got, if it never gets low the buffers could be smaller.
+		adapt_min_queued = std::min(adapt_min_queued, queued_buffers);
+	}
+
+	if(!internal_decode(__FUNCTION__))
+	{
+		return false;
+	}
+	if(!internal_queue_free_buffers(__FUNCTION__))
+	{
+		return false;
+	}
+	if(adaptive)
+	{
+		internal_adapt();
 	}
 	if(state != AL_PLAYING && state != AL_PAUSED)
 	{
@@ -446,6 +950,8 @@ bool AL_OggStream::update()
 		else
 		{
 			//the source under-run
+			++source_underruns;
+			++adapt_underruns;
 			if(!play())
 			{
 				return false;
@@ -506,6 +1012,15 @@ double AL_OggStream::get_total_seconds()
 	return ret;
 }
 
+double AL_OggStream::get_buffer_seconds()
+{
+	ASSERT(!error_state);
+	vorbis_info* vi = ov_info(&vf, -1);
+	ASSERT(vi != NULL && "ov_info");
+	//buffer_size is in samples of all the channels.
+	return static_cast<double>(buffer_size) / (vi->channels * vi->rate);
+}
+
 bool AL_OggStream::seek_to_second(double secs)
 {
 	ASSERT(!error_state);
@@ -518,13 +1033,40 @@ bool AL_OggStream::seek_to_second(double secs)
 	{
 		return false;
 	}
-
-	int ret = ov_time_seek(&vf, secs);
-	if(ret != 0)
+	free_buffers.assign(buffers.get(), buffers.get() + buffer_count);
+	queued_buffers = 0;
+	queued_bytes = 0;
+
+	// this is only safe because the decoder is on this thread, and the source is stopped (for the callback).
+	pcm_ring->clear();
+	decode_eof = false;
+	loop_head_replaying = false;
+
+	ogg_int64_t target = static_cast<ogg_int64_t>(secs * sample_rate);
+	size_t frame_bytes = static_cast<size_t>(channels) * sample_bytes;
+	if(loop_head_ready && static_cast<size_t>(target) * frame_bytes < loop_head.size())
+	{
+		// the head is already decoded, the decoder catches up after the head is copied.
+		loop_head_replaying = true;
+		loop_head_pos = static_cast<size_t>(target) * frame_bytes;
+	}
+	else if(!internal_seek_pcm(__FUNCTION__, target))
 	{
-		internal_print_ov_err(__FUNCTION__, ret, "Failed to seek");
 		return false;
 	}
+	if(!loop_head_ready)
+	{
+		// only capture from the start.
+		if(secs == 0)
+		{
+			internal_reset_loop_head();
+		}
+		else
+		{
+			loop_head.clear();
+			loop_head_capturing = false;
+		}
+	}
 
 	if(!internal_fill_buffers(__FUNCTION__))
 	{
@@ -560,37 +1102,577 @@ void AL_OggStream::internal_print_ov_err(const char* function, int ov_error, con
 
 bool AL_OggStream::internal_fill_buffers(const char* func)
 {
-	vorbis_info* vi = ov_info(&vf, -1);
+	ASSERT(free_buffers.size() == static_cast<size_t>(buffer_count));
+	if(!internal_decode(func))
+	{
+		return false;
+	}
+#ifdef AL_SOFT_callback_buffer
+	if(use_callback)
+	{
+		// the format could be different from the last file, and the callback can't be set while it's attached.
+		p_alBufferCallbackSOFT(buffers[0], alformat, (ALsizei)sample_rate, internal_buffer_callback, this);
+		alSourcei(source_id, AL_BUFFER, (ALint)buffers[0]);
+		if(!internal_check_al_err(func, "Could not set the buffer callback"))
+		{
+			return false;
+		}
+		return true;
+	}
+#endif
+	return internal_queue_free_buffers(func);
+}
+
+#ifdef AL_SOFT_callback_buffer
+ALsizei AL_APIENTRY AL_OggStream::internal_buffer_callback(ALvoid* userptr, ALvoid* sampledata, ALsizei numbytes)
+{
+	// no serr or AL calls here, this is the mixer thread.
+	AL_OggStream* stream = static_cast<AL_OggStream*>(userptr);
+	// if eof was set before the read, everything left is already in the ring.
+	bool eof = stream->decode_eof.load();
+	size_t wanted = numbytes;
+	size_t got = stream->pcm_ring->read(static_cast<char*>(sampledata), wanted);
+	if(got < wanted)
+	{
+		if(eof)
+		{
+			// returning less than asked stops the source.
+			return static_cast<ALsizei>(got);
+		}
+		// the decoder fell behind, silence is better than stopping (zero is silent for float and 16 bit).
+		++stream->ring_underruns;
+		memset(static_cast<char*>(sampledata) + got, 0, wanted - got);
+	}
+	return numbytes;
+}
+#endif
+
+bool AL_OggStream::internal_decode(const char* func)
+{
 	int current_section; // unused
+	// if the file has no samples, looping would spin forever.
+	bool just_looped = false;
 
-	int filled_buffers = 0;
-	for(; filled_buffers < buffer_count; ++filled_buffers)
+	// only decode if the whole chunk fits, because ov_read can't put back what doesn't fit.
+	size_t chunk_bytes = static_cast<size_t>(buffer_size) * sample_bytes;
+	while(!decode_eof.load() && pcm_ring->get_capacity() - pcm_ring->size() >= chunk_bytes)
 	{
-		int bytes_read = ov_read(&vf, (char*)temp_buf.get(), buffer_size * sizeof(short), 0, 2, 1,
-								 &current_section);
+		if(loop_head_replaying)
+		{
+			// a copy, instead of a seek and a decode.
+			size_t count = std::min(loop_head.size() - loop_head_pos, pcm_ring->get_capacity() - pcm_ring->size());
+			pcm_ring->write(loop_head.data() + loop_head_pos, count);
+			loop_head_pos += count;
+			if(count != 0)
+			{
+				just_looped = false;
+			}
+			if(loop_head_pos == loop_head.size())
+			{
+				loop_head_replaying = false;
+				// if the head is the whole file, the decoder is usually still at eof and it loops again,
+				// but a seek could have moved it.
+				if(ov_pcm_tell(&vf) != loop_head_end)
+				{
+					// sample accurate, so there is no gap after the head.
+					if(!internal_seek_pcm(func, loop_head_end))
+					{
+						return false;
+					}
+				}
+			}
+			continue;
+		}
+
+		long bytes_read;
+		if(use_float)
+		{
+			float** pcm;
+			long frames = ov_read_float(&vf, &pcm, buffer_size / channels, &current_section);
+			if(frames > 0)
+			{
+				interleave_float(reinterpret_cast<float*>(decode_buf.get()), pcm, channels, frames);
+				bytes_read = frames * channels * sizeof(float);
+			}
+			else
+			{
+				// 0 (eof) or an error code.
+				bytes_read = frames;
+			}
+		}
+		else
+		{
+			bytes_read = ov_read(&vf, decode_buf.get(), chunk_bytes, 0, 2, 1, &current_section);
+		}
 		if(bytes_read == 0)
 		{
-			// reached eof before buffers are filled
+			if(loop_head_capturing)
+			{
+				// the whole file fits in the head.
+				loop_head_capturing = false;
+				loop_head_ready = true;
+				loop_head_is_file = true;
+				loop_head_end = ov_pcm_tell(&vf);
+			}
+			if((flags & AL_STREAM_LOOPING) && !just_looped)
+			{
+				// looping in the decoder means there is no gap between the end and the start.
+				just_looped = true;
+				if(loop_head_ready && !loop_head.empty())
+				{
+					loop_head_replaying = true;
+					loop_head_pos = 0;
+					continue;
+				}
+				// the head wasn't captured (looping was turned on later, or it seeked away too early).
+				if(!internal_seek_pcm(func, 0))
+				{
+					return false;
+				}
+				internal_reset_loop_head();
+				continue;
+			}
+			decode_eof = true;
 			break;
 		}
 		if(bytes_read < 0)
 		{
-			internal_print_ov_err(func, bytes_read, "Could not read file");
+			internal_print_ov_err(func, static_cast<int>(bytes_read), "Could not read file");
 			return false;
 		}
+		just_looped = false;
+
+		size_t written = pcm_ring->write(decode_buf.get(), bytes_read);
+		ASSERT(written == static_cast<size_t>(bytes_read));
+		(void)written;
+		telemetry.decoded_bytes += bytes_read;
+
+		if(loop_head_capturing)
+		{
+			loop_head.insert(loop_head.end(), decode_buf.get(), decode_buf.get() + bytes_read);
+			if(loop_head.size() >= loop_head_target)
+			{
+				loop_head_capturing = false;
+				loop_head_ready = true;
+				loop_head_end = ov_pcm_tell(&vf);
+			}
+		}
+	}
+	return true;
+}
 
-		alBufferData(buffers[filled_buffers], alformat, temp_buf.get(), (ALsizei)bytes_read,
-					 (ALsizei)vi->rate);
+bool AL_OggStream::internal_seek_pcm(const char* func, ogg_int64_t target)
+{
+	// loop restarts don't need the index.
+	if(!seek_index_tried && target != 0)
+	{
+		seek_index_tried = true;
+		int index_mode = static_cast<int>(cv_openal_seek_index.get_value());
+		// vorbisfile seeks the file itself before reading, so the position can be moved.
+		if(index_mode != 0 && !internal_load_seek_index(file.get(), index_mode == 2))
+		{
+			// the index is only a hint, seeking will bisect instead.
+			std::string reason = serr_check_error() ? serr_get_error() : std::string("unknown error\n");
+			slogf("warning: %s: no seek index for `%s`, reason: %s", func, file_info, reason.c_str());
+			seek_index.clear();
+		}
+	}
+	if(!seek_index.empty() || target == 0)
+	{
+		// the last page that ends before the target, decoding from the start of it reaches the target.
+		auto it = std::upper_bound(seek_index.begin(), seek_index.end(), target,
+								   [](ogg_int64_t value, const AL_OggSeekPoint& point) { return value < point.granule; });
+		// before the first page, the start of the file is the point (loop restarts seek to 0).
+		ogg_int64_t page_offset = 0;
+		if(it != seek_index.begin())
+		{
+			page_offset = std::prev(it)->offset;
+		}
+		int ret = ov_raw_seek(&vf, page_offset);
+		if(ret != 0)
+		{
+			internal_print_ov_err(func, ret, "Failed to seek to the indexed page");
+			return false;
+		}
+		ogg_int64_t position = ov_pcm_tell(&vf);
+		// the granules could have an offset, if so bisect instead.
+		if(position >= 0 && position <= target)
+		{
+			return internal_skip_frames(func, target - position);
+		}
 	}
-	if(!internal_check_al_err(func, "Could not fill buffers"))
+	int ret = ov_pcm_seek(&vf, target);
+	if(ret != 0)
 	{
+		internal_print_ov_err(func, ret, "Failed to seek");
 		return false;
 	}
+	return true;
+}
+
+bool AL_OggStream::internal_skip_frames(const char* func, ogg_int64_t frames)
+{
+	int current_section; // unused
+	while(frames > 0)
+	{
+		int chunk_frames = static_cast<int>(std::min<ogg_int64_t>(frames, buffer_size / channels));
+		long got;
+		if(use_float)
+		{
+			float** pcm;
+			got = ov_read_float(&vf, &pcm, chunk_frames, &current_section);
+		}
+		else
+		{
+			got = ov_read(&vf, decode_buf.get(), chunk_frames * channels * sizeof(short), 0, 2, 1, &current_section);
+			if(got > 0)
+			{
+				got /= channels * sizeof(short);
+			}
+		}
+		if(got == 0)
+		{
+			// past the end.
+			break;
+		}
+		if(got < 0)
+		{
+			internal_print_ov_err(func, static_cast<int>(got), "Could not read file");
+			return false;
+		}
+		frames -= got;
+	}
+	return true;
+}
+
+// the seek index is only a hint, so any errors with the sidecar are warnings.
+// the file is the header followed by the points.
+// the key is the size and the start of the ogg, not the time stamp (which is annoying to get portably).
+struct ogg_index_header
+{
+	char magic[4];
+	Uint32 count;
+	Uint64 file_size;
+	Uint64 key;
+};
+#define OGG_INDEX_MAGIC "DOI1"
+// a sanity check so a corrupt file won't allocate something huge.
+#define OGG_INDEX_MAX_COUNT (16 * 1024 * 1024)
+#define OGG_INDEX_KEY_BYTES 4096
+#define OGG_INDEX_READ_BYTES 8192
+
+bool AL_OggStream::internal_load_seek_index(RWops* source, bool use_sidecar)
+{
+	// the key needs the size, and the file must be seekable anyway.
+	if(source->seek(0, SEEK_END) != 0)
+	{
+		return false;
+	}
+	long file_size = source->tell();
+	if(file_size < 0 || source->seek(0, SEEK_SET) != 0)
+	{
+		return false;
+	}
+	char key_bytes[OGG_INDEX_KEY_BYTES];
+	size_t key_size = source->read(key_bytes, 1, sizeof(key_bytes));
+	if(key_size == 0 && serr_check_error())
+	{
+		return false;
+	}
+	Uint64 key = fnv1a_hash(OGG_INDEX_MAGIC, 4);
+	key = fnv1a_hash(key_bytes, key_size, key);
+
+	std::string sidecar_path;
+	if(use_sidecar)
+	{
+		sidecar_path = file_info;
+		sidecar_path += ".seekidx";
+		//I don't use Unique_RWops_OpenFS because a missing file is normal.
+		FILE* fp = fopen(sidecar_path.c_str(), "rb");
+		if(fp != NULL)
+		{
+			ogg_index_header header;
+			bool valid = (fread(&header, sizeof(header), 1, fp) == 1 &&
+				memcmp(header.magic, OGG_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+				header.key == key && header.file_size == static_cast<Uint64>(file_size) &&
+				header.count <= OGG_INDEX_MAX_COUNT);
+			if(valid)
+			{
+				seek_index.resize(header.count);
+				valid = (fread(seek_index.data(), sizeof(AL_OggSeekPoint), header.count, fp) == header.count);
+			}
+			fclose(fp);
+			if(valid)
+			{
+				return source->seek(0, SEEK_SET) == 0;
+			}
+			// the file changed, it will be rebuilt.
+			seek_index.clear();
+		}
+	}
+
+	// every page that has a granule, vorbis pages are about 4kb, so this is small.
+	ogg_sync_state sync;
+	ogg_sync_init(&sync);
+	if(source->seek(0, SEEK_SET) != 0)
+	{
+		ogg_sync_clear(&sync);
+		return false;
+	}
+	ogg_int64_t offset = 0;
+	ogg_page page;
+	while(true)
+	{
+		long ret = ogg_sync_pageseek(&sync, &page);
+		if(ret > 0)
+		{
+			ogg_int64_t granule = ogg_page_granulepos(&page);
+			// the headers have a granule of 0, and -1 means no packet ends on this page.
+			if(granule > 0)
+			{
+				seek_index.push_back(AL_OggSeekPoint{granule, offset});
+			}
+			offset += ret;
+		}
+		else if(ret < 0)
+		{
+			// skipped garbage.
+			offset -= ret;
+		}
+		else
+		{
+			char* buffer = ogg_sync_buffer(&sync, OGG_INDEX_READ_BYTES);
+			size_t got = source->read(buffer, 1, OGG_INDEX_READ_BYTES);
+			if(got == 0)
+			{
+				break;
+			}
+			ogg_sync_wrote(&sync, static_cast<long>(got));
+		}
+	}
+	ogg_sync_clear(&sync);
+	if(serr_check_error())
+	{
+		seek_index.clear();
+		return false;
+	}
+	if(source->seek(0, SEEK_SET) != 0)
+	{
+		return false;
+	}
+
+	if(use_sidecar)
+	{
+		ogg_index_header header;
+		memcpy(header.magic, OGG_INDEX_MAGIC, sizeof(header.magic));
+		header.count = static_cast<Uint32>(seek_index.size());
+		header.file_size = static_cast<Uint64>(file_size);
+		header.key = key;
+		FILE* fp = fopen(sidecar_path.c_str(), "wb");
+		if(fp == NULL)
+		{
+			slogf("warning: failed to open seek index: `%s`, reason: %s\n", sidecar_path.c_str(), strerror(errno));
+			return true;
+		}
+		if(fwrite(&header, sizeof(header), 1, fp) != 1 ||
+			fwrite(seek_index.data(), sizeof(AL_OggSeekPoint), seek_index.size(), fp) != seek_index.size())
+		{
+			slogf("warning: failed to write seek index: `%s`, reason: %s\n", sidecar_path.c_str(), strerror(errno));
+		}
+		if(fclose(fp) != 0)
+		{
+			slogf("warning: failed to close seek index: `%s`, reason: %s\n", sidecar_path.c_str(), strerror(errno));
+		}
+	}
+	return true;
+}
+
+void AL_OggStream::internal_reset_loop_head()
+{
+	loop_head.clear();
+	loop_head_end = 0;
+	loop_head_ready = false;
+	loop_head_is_file = false;
+	loop_head_replaying = false;
+	loop_head_pos = 0;
+	// only looping streams need it.
+	loop_head_capturing = ((flags & AL_STREAM_LOOPING) != 0);
+}
+
+bool AL_OggStream::internal_queue_free_buffers(const char* func)
+{
+	while(!free_buffers.empty() && queued_buffers < active_buffers)
+	{
+		// if eof was set before the read, everything left is already in the ring.
+		bool eof = decode_eof.load();
+		size_t chunk_bytes = static_cast<size_t>(buffer_size) * sample_bytes;
+		size_t got = pcm_ring->read(temp_buf.get(), chunk_bytes);
+		if(got < chunk_bytes && !eof)
+		{
+			++ring_underruns;
+			++adapt_underruns;
+		}
+		if(got == 0)
+		{
+			break;
+		}
+
+		ALuint bufid = free_buffers.back();
+		alBufferData(bufid, alformat, temp_buf.get(), (ALsizei)got, (ALsizei)sample_rate);
+		alSourceQueueBuffers(source_id, 1, &bufid);
+		if(!internal_check_al_err(func, "Error buffering data"))
+		{
+			return false;
+		}
+		free_buffers.pop_back();
+		++queued_buffers;
+		queued_bytes += got;
+	}
+	return true;
+}
+
+void AL_OggStream::internal_adapt()
+{
+	if(timer_delta<TIMER_MS>(adapt_time, timer_now()) < cv_openal_adapt_ms.get_value())
+	{
+		return;
+	}
+	adapt_time = timer_now();
+
+	int count_min = std::min(static_cast<int>(cv_openal_buffercount_min.get_value()), buffer_count);
+	int count_max = std::min(static_cast<int>(cv_openal_buffercount_max.get_value()), buffer_count);
+	int frames = buffer_size / channels;
+	int frames_min = static_cast<int>(cv_openal_buffersize_min.get_value());
+	int frames_max = static_cast<int>(cv_openal_buffersize_max.get_value());
+
+	telemetry.window_underruns = adapt_underruns;
+	telemetry.window_min_queued = adapt_min_queued;
+
+	if(adapt_underruns != 0)
+	{
+		// more buffers first, because it's a smaller step in latency than doubling the size.
+		if(active_buffers < count_max)
+		{
+			active_buffers = std::min(active_buffers + 2, count_max);
+			++telemetry.grows;
+		}
+		else if(frames < frames_max)
+		{
+			internal_resize_buffers(std::min(frames * 2, frames_max));
+			++telemetry.grows;
+		}
+	}
+	else if(adapt_min_queued > 2)
+	{
+		// at least 2 buffers were never needed, shrink by one step per window.
+		if(frames > frames_min)
+		{
+			internal_resize_buffers(std::max(frames / 2, frames_min));
+			++telemetry.shrinks;
+		}
+		else if(active_buffers > count_min)
+		{
+			--active_buffers;
+			++telemetry.shrinks;
+		}
+	}
+
+	telemetry.buffer_count = active_buffers;
+	telemetry.buffer_frames = buffer_size / channels;
+	adapt_underruns = 0;
+	adapt_min_queued = active_buffers;
+}
+
+void AL_OggStream::internal_resize_buffers(int frames)
+{
+	ASSERT(!use_callback && "the mixer thread reads the ring");
+
+	int new_buffer_size = frames * channels;
+	int new_buffer_bytes = new_buffer_size * sample_bytes;
+	if(buffer_alloc_bytes < new_buffer_bytes)
+	{
+		temp_buf.reset(new char[new_buffer_bytes]);
+		decode_buf.reset(new char[new_buffer_bytes]);
+		buffer_alloc_bytes = new_buffer_bytes;
+	}
+	buffer_size = new_buffer_size;
+
+	size_t ring_size = static_cast<size_t>(new_buffer_bytes) * std::max(static_cast<int>(cv_openal_decode_ahead.get_value()), 1);
+	if(pcm_ring->get_capacity() < ring_size)
+	{
+		// the decoder and the refill are both on this thread, so the ring can be swapped.
+		std::vector<char> pending(pcm_ring->size());
+		size_t got = pcm_ring->read(pending.data(), pending.size());
+		ASSERT(got == pending.size());
+		(void)got;
+		pcm_ring.reset(new spsc_ring<char>(ring_size));
+		pcm_ring->write(pending.data(), pending.size());
+	}
+}
+
+bool AL_LoadOggBuffer(RWops* file, ALuint buffer, double max_seconds, size_t* out_bytes)
+{
+	ASSERT(file != NULL);
+	ASSERT(out_bytes != NULL);
+
+	const char* info = (file->stream_info == NULL ? "<unspecified>" : file->stream_info);
+
+	OggVorbis_File vf;
+	int ret = ov_open_callbacks(file, &vf, NULL, 0, g_oggRWopsCallbacks);
+	if(ret != 0)
+	{
+		serrf("%s Error: Could not initialize ogg stream in `%s` (vorbis: %s)\n", __FUNCTION__, info, ov_err_string(ret));
+		return false;
+	}
+
+	vorbis_info* vi = ov_info(&vf, -1);
+	ASSERT(vi != NULL && "ov_info");
+	ogg_int64_t total = ov_pcm_total(&vf, -1);
+	ALenum format = (vi->channels == 1 ? AL_FORMAT_MONO16 : (vi->channels == 2 ? AL_FORMAT_STEREO16 : 0));
+	if(format == 0)
+	{
+		serrf("%s Error: unsupported channel count in `%s` (got: %d)\n", __FUNCTION__, info, vi->channels);
+		ov_clear(&vf);
+		return false;
+	}
+	if(max_seconds > 0 && (total < 0 || static_cast<double>(total) / vi->rate > max_seconds))
+	{
+		serrf("%s Error: `%s` is too long for a sound, stream it instead (max: %g seconds)\n", __FUNCTION__, info, max_seconds);
+		ov_clear(&vf);
+		return false;
+	}
+
+	// the total is only a hint, unseekable streams don't know it.
+	std::vector<char> pcm;
+	if(total > 0)
+	{
+		pcm.reserve(static_cast<size_t>(total) * vi->channels * sizeof(short));
+	}
+	char chunk[4096];
+	int current_section;
+	while(true)
+	{
+		long bytes_read = ov_read(&vf, chunk, sizeof(chunk), 0, 2, 1, &current_section);
+		if(bytes_read == 0)
+		{
+			break;
+		}
+		if(bytes_read < 0)
+		{
+			serrf("%s Error: Could not read file `%s` (vorbis: %s)\n", __FUNCTION__, info, ov_err_string(static_cast<int>(bytes_read)));
+			ov_clear(&vf);
+			return false;
+		}
+		pcm.insert(pcm.end(), chunk, chunk + bytes_read);
+	}
+	int rate = vi->rate;
+	ov_clear(&vf);
 
-	alSourceQueueBuffers(source_id, filled_buffers, buffers.get());
-	if(!internal_check_al_err(func, "Error queueing buffers"))
+	alBufferData(buffer, format, pcm.data(), static_cast<ALsizei>(pcm.size()), rate);
+	if(!alerr("Could not fill the sound buffer"))
 	{
 		return false;
 	}
+	*out_bytes = pcm.size();
 	return true;
 }
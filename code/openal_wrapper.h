@@ -7,6 +7,8 @@
 #include <vorbis/vorbisfile.h>
 #include <vorbis/codec.h>
 
+#include "spsc_ring.h"
+
 
 // insert msg here: openal error: AL_XXX, Func: ..., File [... @ ...]
 // returns false on error.
@@ -21,12 +23,73 @@ MYNODISCARD bool internal_alcerr(const char* msg, ALCdevice* device, const char*
 MYNODISCARD bool InitAL(const char* device_name = NULL);
 void CloseAL();
 
+// ALC_SOFT_reopen_device, moves the context to another device (NULL = default),
+// the sources and buffers stay valid, so nothing has to be recreated.
+bool AL_CanReopenDevice();
+MYNODISCARD bool AL_ReopenDevice(const char* device_name);
+
+// ALC_EXT_disconnect, false if the device was unplugged (true if it can't be known).
+bool AL_IsDeviceConnected();
+
+// a device without an output, the audio is only mixed when AL_RenderLoopback is called,
+// so the clock runs as fast as the cpu can mix (ALC_SOFT_loopback, for benchmarks).
+// the format is stereo float. CloseAL closes it.
+MYNODISCARD bool InitAL_Loopback(int frequency);
+void AL_RenderLoopback(float* buffer, int frames);
+
+// decodes a whole ogg file into a buffer (for short sounds, see sound_cache.h).
+// fails if the sound is longer than max_seconds (0 = no limit).
+MYNODISCARD bool AL_LoadOggBuffer(RWops* file, ALuint buffer, double max_seconds, size_t* out_bytes);
+
 enum AL_STREAM_FLAGS{
 	AL_STREAM_NONE = 0,
 	AL_STREAM_LOOPING = 1,
 	MAX_AL_STREAM_FLAGS
 };
 
+// how the stream adapted to the machine (see cv_openal_adaptive), and how far ahead it is.
+struct AL_StreamTelemetry
+{
+	// the buffers being queued, and their size in frames.
+	int buffer_count = 0;
+	int buffer_frames = 0;
+	// from the last measured window.
+	Uint32 window_underruns = 0;
+	int window_min_queued = 0;
+	Uint32 grows = 0;
+	Uint32 shrinks = 0;
+
+	// cv_openal_latency, from the last update().
+	// the decoded audio in the ring, and in the queued buffers that haven't played.
+	double ring_ms = 0;
+	double queued_ms = 0;
+	int queued_buffers = 0;
+	double update_ms = 0;
+	// the slowest update() since the last cv_openal_latency_log_ms log.
+	double update_max_ms = 0;
+	// AL_SEC_OFFSET_LATENCY_SOFT, from the source to the speaker, -1 if unsupported.
+	double device_latency_ms = -1;
+
+	// the pcm bytes that came out of the decoder (not the loop head copies).
+	Uint64 decoded_bytes = 0;
+};
+
+// the byte offset of an ogg page, and the granule (pcm position) at the end of it.
+struct AL_OggSeekPoint
+{
+	ogg_int64_t granule;
+	ogg_int64_t offset;
+};
+
+// a source and buffers owned by someone else (like a pool), the stream borrows them until close.
+// the buffer count should come from AL_OggStream::get_voice_buffer_count().
+struct AL_StreamVoice
+{
+	ALuint source = 0;
+	const ALuint* buffers = NULL;
+	int buffer_count = 0;
+};
+
 class AL_OggStream
 {
 public:
@@ -43,9 +106,17 @@ public:
 	
 	//starts off paused
 	//the file will not be moved if an error occurs.
-	MYNODISCARD bool open(Unique_RWops&& file_, int flags_ = AL_STREAM_NONE);
+	//if voice is NULL the stream creates its own source and buffers.
+	MYNODISCARD bool open(Unique_RWops&& file_, int flags_ = AL_STREAM_NONE, const AL_StreamVoice* voice = NULL);
 	
 	MYNODISCARD bool close();
+
+	// for switching devices without ALC_SOFT_reopen_device (see AL_CanReopenDevice).
+	// detach_device releases the source and buffers before CloseAL, the decoder and the ring stay,
+	// attach_device requeues the ring on the new device and resumes if it was playing.
+	// the audio that was queued on the old device is lost, but the position is exact.
+	MYNODISCARD bool detach_device();
+	MYNODISCARD bool attach_device(const AL_StreamVoice* voice = NULL);
 	
 	MYNODISCARD bool update();
 	
@@ -58,6 +129,9 @@ public:
 	double get_progress_seconds();
 	
 	double get_total_seconds();
+
+	//the length of audio in one buffer, update() should be called at least this often.
+	double get_buffer_seconds();
 	
 	MYNODISCARD bool seek_to_second(double secs);
 
@@ -85,6 +159,35 @@ public:
 	{
 		flags = (on ? (flags | AL_STREAM_LOOPING) : (flags & ~AL_STREAM_LOOPING));
 	}
+
+	// the number of buffers a voice needs for the current settings (requires openal to be initialized).
+	static int get_voice_buffer_count();
+
+	// the memory used by the decoded audio (including the openal buffers).
+	size_t get_memory_bytes() const;
+
+	ALuint get_source() const
+	{
+		return source_id;
+	}
+
+	//the number of times a buffer couldn't be filled because the decoder fell behind.
+	Uint32 get_ring_underruns() const
+	{
+		return ring_underruns.load();
+	}
+
+	//the number of times the source ran out of queued buffers and had to be restarted.
+	Uint32 get_source_underruns() const
+	{
+		return source_underruns.load();
+	}
+
+	//not thread safe, only read it from the thread calling update().
+	const AL_StreamTelemetry& get_telemetry() const
+	{
+		return telemetry;
+	}
 	
 private:
 	Unique_RWops file; // the file that this holds the compressed stream of audio data
@@ -95,10 +198,68 @@ private:
 	OggVorbis_File vf;
 
 	// I don't know the size because I expect to change the size with config options.
-	std::unique_ptr<short[]> temp_buf; // used to decompress audio into, vorbis only supports 16bit
+	std::unique_ptr<char[]> temp_buf; // used to copy from the ring into a buffer
+	std::unique_ptr<char[]> decode_buf; // used to decompress audio into (16 bit or float samples)
 	std::unique_ptr<ALuint[]> buffers; // the openal buffer id's
-	int buffer_count = 0;
-	int buffer_size = 0;
+	std::vector<ALuint> free_buffers; // unqueued buffers waiting for data
+	int buffer_count = 0; // allocated
+	int active_buffers = 0; // the most that will be queued
+	int queued_buffers = 0;
+	Sint64 queued_bytes = 0;
+	int buffer_size = 0; // in samples of all the channels
+	int buffer_alloc_bytes = 0;
+	int sample_rate = 0;
+	int channels = 0;
+	// AL_EXT_float32, ov_read_float skips the conversion and clipping of ov_read.
+	bool use_float = false;
+	int sample_bytes = sizeof(short);
+
+	// decoded audio, the decoder is the producer, and the buffer refills are the consumer.
+	// with the callback the consumer is the openal mixer thread.
+	std::unique_ptr<spsc_ring<char>> pcm_ring; // in bytes
+	std::atomic_bool decode_eof{false};
+	std::atomic<Uint32> ring_underruns{0};
+	std::atomic<Uint32> source_underruns{0};
+
+	// cv_openal_seek_index, sorted by granule.
+	// seeks go straight to the page before the target with ov_raw_seek,
+	// instead of ov_time_seek bisecting the file with many small reads.
+	std::vector<AL_OggSeekPoint> seek_index;
+	// the index is built by the first seek that isn't to the start, so streams that never seek don't read the file.
+	bool seek_index_tried = false;
+
+	// cv_openal_adaptive, the buffer count and size move between the limits.
+	bool adaptive = false;
+	TIMER_U adapt_time;
+	Uint32 adapt_underruns = 0;
+	int adapt_min_queued = 0;
+	AL_StreamTelemetry telemetry;
+
+	// AL_SOFT_source_latency
+	bool has_source_latency = false;
+	TIMER_U latency_log_time;
+
+	// gapless looping, the start of the file is kept decoded (about the size of the ring).
+	// at eof the head is copied into the ring, and the only seek is to the end of the head,
+	// which happens after the head was copied, so the loop never stalls the refill.
+	std::vector<char> loop_head;
+	size_t loop_head_target = 0;
+	// the pcm position right after the head.
+	ogg_int64_t loop_head_end = 0;
+	// capturing the head while decoding from the start.
+	bool loop_head_capturing = false;
+	// the head is finished (reached the target or eof).
+	bool loop_head_ready = false;
+	// the head is the whole file, so looping never seeks.
+	bool loop_head_is_file = false;
+	bool loop_head_replaying = false;
+	size_t loop_head_pos = 0;
+
+	// AL_SOFT_callback_buffer, the mixer pulls from pcm_ring into a single buffer,
+	// instead of queueing cv_openal_buffercount buffers.
+	bool use_callback = false;
+	// the source and buffers came from an AL_StreamVoice, close won't delete them.
+	bool shared_voice = false;
 	ALuint source_id = 0;
 	ALenum alformat = 0;
 	int flags = AL_STREAM_NONE;
@@ -110,6 +271,45 @@ private:
 	MYNODISCARD bool internal_check_al_err(const char* function, const char* reason);
 	
 	void internal_print_ov_err(const char* function, int ov_error, const char* reason);
+
+	MYNODISCARD bool internal_update();
+
+	// creates (or takes from the voice) the source and buffers.
+	MYNODISCARD bool internal_create_al(const char* func, const AL_StreamVoice* voice);
+
+	// fills the latency part of the telemetry.
+	MYNODISCARD bool internal_measure_latency(const char* func, double update_ms);
 	
 	MYNODISCARD bool internal_fill_buffers(const char* func);
+
+	// decodes until the ring is full (or eof).
+	// looping streams continue from the start without a gap.
+	MYNODISCARD bool internal_decode(const char* func);
+
+	// fills the free buffers from the ring and queues them.
+	MYNODISCARD bool internal_queue_free_buffers(const char* func);
+
+	// grows or shrinks the buffers every cv_openal_adapt_ms.
+	void internal_adapt();
+
+	// changes the buffer size, the ring grows if needed.
+	void internal_resize_buffers(int frames);
+
+	// the decoder is at the start of the file.
+	void internal_reset_loop_head();
+
+	// builds the seek index, or loads it from the sidecar file.
+	// leaves the file at the start.
+	MYNODISCARD bool internal_load_seek_index(RWops* source, bool use_sidecar);
+
+	// uses the seek index if there is one (and builds it the first time).
+	MYNODISCARD bool internal_seek_pcm(const char* func, ogg_int64_t target);
+
+	// decodes and throws away the frames.
+	MYNODISCARD bool internal_skip_frames(const char* func, ogg_int64_t frames);
+
+#ifdef AL_SOFT_callback_buffer
+	// called by the openal mixer thread.
+	static ALsizei AL_APIENTRY internal_buffer_callback(ALvoid* userptr, ALvoid* sampledata, ALsizei numbytes);
+#endif
 };
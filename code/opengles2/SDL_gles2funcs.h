@@ -25,9 +25,14 @@
 #ifdef DESKTOP_GL
 //desktop GL will always choose non extensions, since angle es2.0 is better for extensions, due to dx9 -> es2 support
 #define SDL_PROC_OES(ret,func,params) SDL_PROC(ret,func,params)
-#define SDL_PROC_ANGLE(ret,func,params) SDL_PROC_EXTENSION(ret,func,func,params)
-#define SDL_PROC_KHR(ret,func,params) SDL_PROC_EXTENSION(ret,func,func,params)
-#define SDL_PROC_EXT(ret,func,params) SDL_PROC_EXTENSION(ret,func,func,params)
+//the extension suffix is left empty so the core name is loaded (passing func twice would load "glFuncglFunc").
+#define SDL_PROC_ANGLE(ret,func,params) SDL_PROC_EXTENSION(ret,func,,params)
+#define SDL_PROC_KHR(ret,func,params) SDL_PROC_EXTENSION(ret,func,,params)
+#define SDL_PROC_EXT(ret,func,params) SDL_PROC_EXTENSION(ret,func,,params)
+//like SDL_PROC_OES, but the function could be NULL (eg: ARB extensions that are core in newer versions).
+#define SDL_PROC_OES_OPTIONAL(ret,func,params) SDL_PROC_EXTENSION(ret,func,,params)
+//framebuffer objects are not core in gl 2.1, but ARB_framebuffer_object uses the core names (check for NULL).
+#define SDL_PROC_FBO(ret,func,params) SDL_PROC_EXTENSION(ret,func,,params)
 
 #define ROBUSTNESS_EXTENSION(x) x##_ARB
 
@@ -37,9 +42,35 @@
 #define SDL_PROC_ANGLE(ret,func,params) SDL_PROC_EXTENSION(ret,func,ANGLE,params)
 #define SDL_PROC_KHR(ret,func,params) SDL_PROC_EXTENSION(ret,func,KHR,params)
 #define SDL_PROC_EXT(ret,func,params) SDL_PROC_EXTENSION(ret,func,EXT,params)
+#define SDL_PROC_OES_OPTIONAL(ret,func,params) SDL_PROC_EXTENSION(ret,func,OES,params)
+#define SDL_PROC_FBO(ret,func,params) SDL_PROC(ret,func,params)
 
 #define ROBUSTNESS_EXTENSION(x) x##_EXT
 
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH_OES
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS GL_NUM_PROGRAM_BINARY_FORMATS_OES
+#endif
+#ifndef GL_PROGRAM_BINARY_FORMATS
+#define GL_PROGRAM_BINARY_FORMATS GL_PROGRAM_BINARY_FORMATS_OES
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+//only exists in es3, but the value is the same.
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED GL_TIME_ELAPSED_EXT
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT GL_QUERY_RESULT_EXT
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE GL_QUERY_RESULT_AVAILABLE_EXT
+#endif
+
 #ifndef GL_DEBUG_TYPE_ERROR
 #define GL_DEBUG_TYPE_ERROR GL_DEBUG_TYPE_ERROR_KHR
 #endif
@@ -105,6 +136,24 @@ SDL_PROC_KHR(void, glDebugMessageControl, (GLenum source,
    GLboolean enabled))
 SDL_PROC_KHR(void, glDebugMessageCallback, (GLDEBUGPROC, const void*))
 
+//GL_ARB_get_program_binary / GL_OES_get_program_binary
+SDL_PROC_OES_OPTIONAL(void, glGetProgramBinary, (GLuint, GLsizei, GLsizei *, GLenum *, void *))
+SDL_PROC_OES_OPTIONAL(void, glProgramBinary, (GLuint, GLenum, const void *, GLint))
+//only desktop GL 4.1 (or the ARB extension) and es3 have this, es2 will always be NULL.
+SDL_PROC_EXTENSION(void, glProgramParameteri, , (GLuint, GLenum, GLint))
+
+//GL_KHR_parallel_shader_compile (the KHR suffix is used on desktop too)
+SDL_PROC_EXTENSION(void, glMaxShaderCompilerThreadsKHR, , (GLuint))
+
+//GL_ARB_timer_query / GL_EXT_disjoint_timer_query (queries are core in gl 1.5, but not in es2)
+SDL_PROC_EXT(void, glGenQueries, (GLsizei, GLuint *))
+SDL_PROC_EXT(void, glDeleteQueries, (GLsizei, const GLuint *))
+SDL_PROC_EXT(void, glBeginQuery, (GLenum, GLuint))
+SDL_PROC_EXT(void, glEndQuery, (GLenum))
+SDL_PROC_EXT(void, glGetQueryObjectuiv, (GLuint, GLenum, GLuint *))
+//Uint64 because es2 headers don't agree on the name of GLuint64.
+SDL_PROC_EXT(void, glGetQueryObjectui64v, (GLuint, GLenum, Uint64 *))
+
 //ANGLE_instanced_arrays
 SDL_PROC_ANGLE(void, glDrawArraysInstanced, (GLenum, GLint, GLsizei,GLsizei))
 SDL_PROC_ANGLE(void, glDrawElementsInstanced, (GLenum, GLsizei, GLenum, const void *, GLsizei))
@@ -131,7 +180,7 @@ SDL_PROC(void, glDrawArrays, (GLenum, GLint, GLsizei))
 SDL_PROC(void, glEnable, (GLenum))
 SDL_PROC(void, glEnableVertexAttribArray, (GLuint))
 SDL_PROC(void, glFinish, (void))
-SDL_PROC_GL2_COMPAT(void, glGenFramebuffers, (GLsizei, GLuint *))
+SDL_PROC_FBO(void, glGenFramebuffers, (GLsizei, GLuint *))
 SDL_PROC(void, glGenTextures, (GLsizei, GLuint *))
 SDL_PROC(void, glGetBooleanv, (GLenum, GLboolean *))
 SDL_PROC(const GLubyte *, glGetString, (GLenum))
@@ -156,10 +205,10 @@ SDL_PROC(void, glUniformMatrix4fv, (GLint, GLsizei, GLboolean, const GLfloat *))
 SDL_PROC(void, glUseProgram, (GLuint))
 SDL_PROC(void, glVertexAttribPointer, (GLuint, GLint, GLenum, GLboolean, GLsizei, const void *))
 SDL_PROC(void, glViewport, (GLint, GLint, GLsizei, GLsizei))
-SDL_PROC_GL2_COMPAT(void, glBindFramebuffer, (GLenum, GLuint))
-SDL_PROC_GL2_COMPAT(void, glFramebufferTexture2D, (GLenum, GLenum, GLenum, GLuint, GLint))
-SDL_PROC_GL2_COMPAT(GLenum, glCheckFramebufferStatus, (GLenum))
-SDL_PROC_GL2_COMPAT(void, glDeleteFramebuffers, (GLsizei, const GLuint *))
+SDL_PROC_FBO(void, glBindFramebuffer, (GLenum, GLuint))
+SDL_PROC_FBO(void, glFramebufferTexture2D, (GLenum, GLenum, GLenum, GLuint, GLint))
+SDL_PROC_FBO(GLenum, glCheckFramebufferStatus, (GLenum))
+SDL_PROC_FBO(void, glDeleteFramebuffers, (GLsizei, const GLuint *))
 SDL_PROC(GLint, glGetAttribLocation, (GLuint, const GLchar *))
 SDL_PROC(void, glGetProgramInfoLog, (GLuint, GLsizei, GLsizei*, GLchar*))
 SDL_PROC(void, glGenBuffers, (GLsizei, GLuint *))
@@ -172,5 +221,7 @@ SDL_PROC(void, glBufferSubData, (GLenum, GLintptr, GLsizeiptr, const GLvoid *))
 #undef SDL_PROC_ANGLE
 #undef SDL_PROC_KHR
 #undef SDL_PROC_EXT
+#undef SDL_PROC_OES_OPTIONAL
+#undef SDL_PROC_FBO
 
 #undef SDL_PROC_GL2_COMPAT
@@ -0,0 +1,83 @@
+#include "global.h"
+#include "render_queue.h"
+
+render_command_list& render_queue::begin_record()
+{
+	std::lock_guard<std::mutex> lock(mut);
+	//if the render thread didn't take the last frame, it's replaced.
+	ready = false;
+	render_command_list& list = lists[record_index];
+	list.commands.clear();
+	return list;
+}
+
+void render_queue::submit()
+{
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		ready = true;
+	}
+	cond.notify_all();
+}
+
+bool render_queue::wait_for_pickup(int timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(mut);
+	return cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return !ready || stopped; });
+}
+
+const render_command_list* render_queue::wait_for_frame(int timeout_ms)
+{
+	const render_command_list* list = NULL;
+	{
+		std::unique_lock<std::mutex> lock(mut);
+		if(!cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return ready || stopped; }))
+		{
+			return NULL;
+		}
+		if(stopped)
+		{
+			return NULL;
+		}
+		list = &lists[record_index];
+		record_index ^= 1;
+		ready = false;
+	}
+	cond.notify_all();
+	return list;
+}
+
+void render_queue::finish_frame(TIMER_RESULT render_ms)
+{
+	std::lock_guard<std::mutex> lock(mut);
+	last_render_ms = render_ms;
+	has_render_ms = true;
+}
+
+bool render_queue::pop_render_ms(TIMER_RESULT* render_ms_out)
+{
+	ASSERT(render_ms_out != NULL);
+	std::lock_guard<std::mutex> lock(mut);
+	if(!has_render_ms)
+	{
+		return false;
+	}
+	has_render_ms = false;
+	*render_ms_out = last_render_ms;
+	return true;
+}
+
+void render_queue::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		stopped = true;
+	}
+	cond.notify_all();
+}
+
+bool render_queue::is_stopped()
+{
+	std::lock_guard<std::mutex> lock(mut);
+	return stopped;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "render_scale.h"
+
+enum
+{
+	RCMD_DRAW_BASIC,
+	//arg = the gif frame
+	RCMD_DRAW_GIF,
+	RCMD_DRAW_COLORFUL
+};
+
+struct render_command
+{
+	int type;
+	int arg;
+};
+
+//everything the render thread needs to draw a frame.
+//the commands are state, not deltas, so a frame can be dropped.
+struct render_command_list
+{
+	float clear_color[3]{};
+	render_layout layout;
+	int drawable_w = 0;
+	int drawable_h = 0;
+	//GL_NEAREST or GL_LINEAR for the scene framebuffer.
+	int filter = 0;
+	//false if the frame before this was skipped (idle), so the present interval is meaningless.
+	bool continuous = false;
+	std::vector<render_command> commands;
+
+	void push(int type, int arg = 0)
+	{
+		commands.push_back(render_command{type, arg});
+	}
+};
+
+//double buffered command lists from the logic thread to the render thread.
+//the logic thread records into one list while the render thread executes the other.
+//if the render thread is still busy with the previous frame, 
+//the next recorded frame replaces the unread one, so the logic thread never waits for the swap.
+class render_queue
+{
+public:
+	//logic thread, returns the list to record into (cleared).
+	render_command_list& begin_record();
+	//logic thread, hands the list to the render thread.
+	void submit();
+	//logic thread, waits until the render thread took the submitted frame.
+	//returns false if it timed out (the render thread is stuck in the driver).
+	bool wait_for_pickup(int timeout_ms);
+
+	//render thread, returns NULL if it timed out or stopped.
+	//the list is valid until the next call.
+	const render_command_list* wait_for_frame(int timeout_ms);
+	//render thread, the time it took to render the frame (for the render scale).
+	void finish_frame(TIMER_RESULT render_ms);
+
+	//logic thread, returns true if a frame finished since the last call.
+	bool pop_render_ms(TIMER_RESULT* render_ms_out);
+
+	void stop();
+	bool is_stopped();
+
+private:
+	std::mutex mut;
+	std::condition_variable cond;
+	render_command_list lists[2];
+	//the other list belongs to the render thread.
+	int record_index = 0;
+	bool ready = false;
+	bool stopped = false;
+	bool has_render_ms = false;
+	TIMER_RESULT last_render_ms = 0;
+};
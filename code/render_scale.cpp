@@ -0,0 +1,134 @@
+#include "global.h"
+#include "render_scale.h"
+#include "cvar.h"
+
+#include <math.h>
+
+static cvar& cv_render_scale = register_cvar_value(
+	"cv_render_scale", 1.0, "the resolution of the scene relative to the screen (0.25 to 2), with cv_render_scale_auto this is the maximum", CVAR_DEFAULT);
+static cvar& cv_render_scale_auto = register_cvar_value(
+	"cv_render_scale_auto", 0, "1 = lower the render scale when the frame time is above cv_render_scale_target_ms", CVAR_DEFAULT);
+static cvar& cv_render_scale_target_ms = register_cvar_value(
+	"cv_render_scale_target_ms", 1000.0 / 60.0, "the frame time that cv_render_scale_auto tries to stay under", CVAR_DEFAULT);
+static cvar& cv_render_scale_min = register_cvar_value(
+	"cv_render_scale_min", 0.5, "the lowest scale cv_render_scale_auto can pick", CVAR_DEFAULT);
+static cvar& cv_render_scale_frames = register_cvar_value(
+	"cv_render_scale_frames", 30, "the number of frames averaged before cv_render_scale_auto changes the scale", CVAR_DEFAULT);
+
+#define RENDER_SCALE_MIN 0.25
+#define RENDER_SCALE_MAX 2.0
+//the most the auto scale can change at once, big jumps look bad.
+#define RENDER_SCALE_MAX_STEP 0.1
+
+render_layout calc_render_layout(int drawable_w, int drawable_h, int logical_w, int logical_h, int mode, double scale)
+{
+	render_layout layout;
+	layout.viewport_w = drawable_w;
+	layout.viewport_h = drawable_h;
+
+	switch(mode)
+	{
+	case FULLSCREEN_MODE_INTEGER_SCALE:
+	{
+		int factor = std::min(drawable_w / logical_w, drawable_h / logical_h);
+		if(factor >= 1)
+		{
+			layout.viewport_w = logical_w * factor;
+			layout.viewport_h = logical_h * factor;
+			break;
+		}
+		//too small
+	}
+	//fallthrough
+	case FULLSCREEN_MODE_LETTERBOX:
+	{
+		//fit the aspect ratio.
+		if(static_cast<Sint64>(drawable_w) * logical_h > static_cast<Sint64>(drawable_h) * logical_w)
+		{
+			layout.viewport_w = static_cast<int>((static_cast<Sint64>(drawable_h) * logical_w) / logical_h);
+		}
+		else
+		{
+			layout.viewport_h = static_cast<int>((static_cast<Sint64>(drawable_w) * logical_h) / logical_w);
+		}
+		break;
+	}
+	case FULLSCREEN_MODE_STRETCH:
+		break;
+	default:
+		//fit to screen / native, the scene is the size of the screen.
+		logical_w = drawable_w;
+		logical_h = drawable_h;
+		break;
+	}
+
+	layout.viewport_w = std::max(layout.viewport_w, 1);
+	layout.viewport_h = std::max(layout.viewport_h, 1);
+	layout.viewport_x = (drawable_w - layout.viewport_w) / 2;
+	layout.viewport_y = (drawable_h - layout.viewport_h) / 2;
+
+	layout.scene_w = std::max(static_cast<int>(lround(logical_w * scale)), 1);
+	layout.scene_h = std::max(static_cast<int>(lround(logical_h * scale)), 1);
+	return layout;
+}
+
+static double clamp_scale(double scale)
+{
+	return std::max(RENDER_SCALE_MIN, std::min(RENDER_SCALE_MAX, scale));
+}
+
+double render_scale_controller::get_scale() const
+{
+	if(cv_render_scale_auto.get_value() == 0.0 || auto_scale < 0)
+	{
+		return clamp_scale(cv_render_scale.get_value());
+	}
+	return auto_scale;
+}
+
+void render_scale_controller::add_frame(TIMER_RESULT frame_ms)
+{
+	double max_scale = clamp_scale(cv_render_scale.get_value());
+	if(cv_render_scale_auto.get_value() == 0.0)
+	{
+		auto_scale = -1;
+		total_ms = 0;
+		samples = 0;
+		return;
+	}
+	if(auto_scale < 0)
+	{
+		auto_scale = max_scale;
+	}
+
+	total_ms += frame_ms;
+	++samples;
+	if(samples < std::max(1, static_cast<int>(cv_render_scale_frames.get_value())))
+	{
+		return;
+	}
+	TIMER_RESULT average_ms = total_ms / samples;
+	total_ms = 0;
+	samples = 0;
+
+	double min_scale = std::min(clamp_scale(cv_render_scale_min.get_value()), max_scale);
+	TIMER_RESULT target_ms = cv_render_scale_target_ms.get_value();
+	if(average_ms <= 0 || target_ms <= 0)
+	{
+		return;
+	}
+
+	//the fill cost is the area, so the scale is the square root.
+	//the gap between lowering and raising is so it doesn't flip back and forth.
+	double new_scale = auto_scale;
+	if(average_ms > target_ms)
+	{
+		new_scale = auto_scale * sqrt((target_ms * 0.9) / average_ms);
+	}
+	else if(average_ms < target_ms * 0.7)
+	{
+		new_scale = auto_scale * sqrt((target_ms * 0.8) / average_ms);
+	}
+	new_scale = std::max(auto_scale - RENDER_SCALE_MAX_STEP, std::min(auto_scale + RENDER_SCALE_MAX_STEP, new_scale));
+	auto_scale = std::max(min_scale, std::min(max_scale, new_scale));
+}
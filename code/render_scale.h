@@ -0,0 +1,47 @@
+#pragma once
+
+enum{
+	FULLSCREEN_MODE_FIT_TO_SCREEN  = 0,
+	FULLSCREEN_MODE_NATIVE = 1,
+	FULLSCREEN_MODE_STRETCH = 2,
+	FULLSCREEN_MODE_LETTERBOX = 3,
+	//like letterbox, but only scales by whole numbers (for pixel art), falls back to letterbox if the screen is too small.
+	FULLSCREEN_MODE_INTEGER_SCALE = 4
+};
+
+struct render_layout
+{
+	//the size of the scene framebuffer (after the render scale)
+	int scene_w = 0;
+	int scene_h = 0;
+	//where the scene is drawn on the window.
+	int viewport_x = 0;
+	int viewport_y = 0;
+	int viewport_w = 0;
+	int viewport_h = 0;
+
+	//false if the scene can be drawn directly into the window.
+	bool needs_scaling(int drawable_w, int drawable_h) const
+	{
+		return scene_w != viewport_w || scene_h != viewport_h || viewport_w != drawable_w || viewport_h != drawable_h;
+	}
+};
+
+//drawable = the size of the window in pixels.
+//logical = the size of the scene at a scale of 1.0 (for fit to screen this is the drawable size).
+render_layout calc_render_layout(int drawable_w, int drawable_h, int logical_w, int logical_h, int mode, double scale);
+
+//the render scale from cv_render_scale, 
+//or if cv_render_scale_auto is on, it's lowered when the frames take too long (and raised back up to cv_render_scale).
+class render_scale_controller
+{
+public:
+	double get_scale() const;
+	//call once per frame, frame_ms should not include waiting for vsync.
+	void add_frame(TIMER_RESULT frame_ms);
+
+private:
+	double auto_scale = -1;
+	TIMER_RESULT total_ms = 0;
+	int samples = 0;
+};
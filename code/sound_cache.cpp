@@ -0,0 +1,220 @@
+#include "global.h"
+
+#include "SDL_wrapper.h"
+#include "cvar.h"
+#include "openal_wrapper.h"
+#include "mini_tools.h"
+#include "sound_cache.h"
+
+static cvar& cv_sound_cache_kb = register_cvar_value(
+	"cv_sound_cache_kb", 8192, "the memory budget of decoded sounds, sounds being played can go over", CVAR_DEFAULT);
+static cvar& cv_sound_max_seconds = register_cvar_value(
+	"cv_sound_max_seconds", 10, "sounds longer than this must be streamed instead", CVAR_DEFAULT);
+
+//shared by every cache, only the order matters.
+static std::atomic<Uint64> g_sound_use_counter{0};
+
+void sound_buffer::touch()
+{
+	last_use = ++g_sound_use_counter;
+}
+
+sound_ref sound_cache::load(const char* path)
+{
+	ASSERT(path != NULL);
+
+	auto path_it = paths.find(path);
+	if(path_it != paths.end())
+	{
+		auto sound_it = sounds.find(path_it->second);
+		ASSERT(sound_it != sounds.end());
+		++path_hits;
+		sound_it->second->touch();
+		return sound_it->second;
+	}
+
+	//the whole file is hashed, and it's small anyway.
+	Unique_RWops file = Unique_RWops_OpenMapped(path, RWOPS_MAP_SEQUENTIAL);
+	if(!file)
+	{
+		return NULL;
+	}
+	ASSERT(file->data() != NULL || file->size() == 0);
+
+	Uint64 hash = fnv1a_hash(file->data(), file->size());
+	auto sound_it = sounds.find(hash);
+	if(sound_it != sounds.end())
+	{
+		paths[path] = hash;
+		++hash_hits;
+		sound_it->second->touch();
+		return sound_it->second;
+	}
+
+	sound_ref sound = std::make_shared<sound_buffer>();
+	sound->hash = hash;
+	sound->path = path;
+	sound->touch();
+
+	alGenBuffers(1, &sound->buffer);
+	if(!alerr("sound_cache: Could not create buffer"))
+	{
+		return NULL;
+	}
+
+	if(!AL_LoadOggBuffer(file.get(), sound->buffer, cv_sound_max_seconds.get_value(), &sound->bytes))
+	{
+		alDeleteBuffers(1, &sound->buffer);
+		return NULL;
+	}
+	file.reset();
+	if(serr_check_error())
+	{
+		alDeleteBuffers(1, &sound->buffer);
+		return NULL;
+	}
+
+	sounds[hash] = sound;
+	paths[path] = hash;
+	total_bytes += sound->bytes;
+	++decodes;
+
+	//the new sound is referenced, so it won't be evicted.
+	trim(static_cast<size_t>(cv_sound_cache_kb.get_value()) * 1024);
+
+	return sound;
+}
+
+void sound_cache::trim(size_t budget_bytes)
+{
+	while(total_bytes > budget_bytes)
+	{
+		auto oldest = sounds.end();
+		for(auto it = sounds.begin(); it != sounds.end(); ++it)
+		{
+			//the cache is the only owner.
+			if(it->second.use_count() == 1 && (oldest == sounds.end() || it->second->last_use.load() < oldest->second->last_use.load()))
+			{
+				oldest = it;
+			}
+		}
+		if(oldest == sounds.end())
+		{
+			//everything is being used.
+			break;
+		}
+
+		sound_buffer& sound = *oldest->second;
+		alDeleteBuffers(1, &sound.buffer);
+		ALenum al_error = alGetError();
+		if(al_error != AL_NO_ERROR)
+		{
+			slogf("warning: sound_cache: failed to delete `%s` (openal: %s)\n", sound.path.c_str(), alGetString(al_error));
+		}
+		total_bytes -= sound.bytes;
+		for(auto path_it = paths.begin(); path_it != paths.end();)
+		{
+			if(path_it->second == sound.hash)
+			{
+				path_it = paths.erase(path_it);
+			}
+			else
+			{
+				++path_it;
+			}
+		}
+		sounds.erase(oldest);
+		++evictions;
+	}
+}
+
+void sound_cache::release_device()
+{
+	for(auto it = sounds.begin(); it != sounds.end();)
+	{
+		sound_buffer& sound = *it->second;
+		alDeleteBuffers(1, &sound.buffer);
+		ALenum al_error = alGetError();
+		if(al_error != AL_NO_ERROR)
+		{
+			slogf("warning: sound_cache: failed to delete `%s` (openal: %s)\n", sound.path.c_str(), alGetString(al_error));
+		}
+		sound.buffer = 0;
+		if(it->second.use_count() == 1)
+		{
+			//it will be loaded again if it's used.
+			total_bytes -= sound.bytes;
+			for(auto path_it = paths.begin(); path_it != paths.end();)
+			{
+				if(path_it->second == sound.hash)
+				{
+					path_it = paths.erase(path_it);
+				}
+				else
+				{
+					++path_it;
+				}
+			}
+			it = sounds.erase(it);
+			continue;
+		}
+		++it;
+	}
+}
+
+bool sound_cache::restore_device()
+{
+	for(auto& entry : sounds)
+	{
+		sound_buffer& sound = *entry.second;
+		ASSERT(sound.buffer == 0 && "release_device first");
+		alGenBuffers(1, &sound.buffer);
+		if(!alerr("sound_cache: Could not create buffer"))
+		{
+			sound.buffer = 0;
+			return false;
+		}
+		//the size won't change, unless the file did.
+		Unique_RWops file = Unique_RWops_OpenMapped(sound.path.c_str(), RWOPS_MAP_SEQUENTIAL);
+		size_t bytes = 0;
+		if(!file || !AL_LoadOggBuffer(file.get(), sound.buffer, cv_sound_max_seconds.get_value(), &bytes))
+		{
+			return false;
+		}
+		total_bytes = total_bytes - sound.bytes + bytes;
+		sound.bytes = bytes;
+		++decodes;
+	}
+	return true;
+}
+
+bool sound_cache::destroy()
+{
+	bool success = true;
+	for(auto& entry : sounds)
+	{
+		sound_buffer& sound = *entry.second;
+		if(entry.second.use_count() != 1)
+		{
+			//a source could still be playing it.
+			serrf("sound_cache: `%s` is still referenced (%ld)\n", sound.path.c_str(), entry.second.use_count() - 1);
+			success = false;
+			continue;
+		}
+		alDeleteBuffers(1, &sound.buffer);
+		if(!alerr("sound_cache: Failed to delete buffer"))
+		{
+			success = false;
+		}
+	}
+	sounds.clear();
+	paths.clear();
+	total_bytes = 0;
+	return success;
+}
+
+void sound_cache::print_stats() const
+{
+	slogf("sound cache: %zu sounds, %zu KB, path hits: %u, hash hits: %u, decodes: %u, evictions: %u\n",
+		  sounds.size(), total_bytes / 1024, path_hits, hash_hits, decodes, evictions);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+//short sounds are decoded once into an openal buffer,
+//any number of sources can play the same buffer (see audio_engine::play_sound).
+struct sound_buffer
+{
+	ALuint buffer = 0;
+	size_t bytes = 0;
+	Uint64 hash = 0;
+	//the first path that loaded this.
+	std::string path;
+	//for the LRU, atomic because the refs are played from any thread.
+	std::atomic<Uint64> last_use{0};
+
+	//marks the sound as used (loaded or played), so it's evicted last.
+	void touch();
+};
+
+//holding a sound_ref keeps the buffer from being evicted.
+typedef std::shared_ptr<sound_buffer> sound_ref;
+
+//the sounds are keyed by the path, and by the hash of the file,
+//so different paths to the same file share the buffer.
+//sounds that aren't referenced are evicted (least recently used first) when over cv_sound_cache_kb.
+//only use this on the thread with the openal context (the refs can be held anywhere).
+class sound_cache
+{
+public:
+	~sound_cache()
+	{
+		//the destructor cannot capture serr, so I can only resort to ASSERT.
+		//you should never rely on the destructor.
+		if(!destroy())
+		{
+			ASSERT(false && "destroy");
+		}
+	}
+
+	//returns NULL on error.
+	//the file is only read if the path wasn't loaded before.
+	sound_ref load(const char* path);
+
+	//evicts unreferenced sounds until the cache fits in the budget.
+	void trim(size_t budget_bytes);
+
+	//for audio_engine::switch_device, when the device has to be recreated.
+	//release_device deletes the buffers before CloseAL (unreferenced sounds are dropped),
+	//restore_device decodes the referenced sounds again after InitAL.
+	void release_device();
+	MYNODISCARD bool restore_device();
+
+	//every ref must be released first.
+	MYNODISCARD bool destroy();
+
+	size_t get_memory_bytes() const
+	{
+		return total_bytes;
+	}
+
+	void print_stats() const;
+
+private:
+	std::unordered_map<Uint64, sound_ref> sounds;
+	std::unordered_map<std::string, Uint64> paths;
+	size_t total_bytes = 0;
+
+	Uint32 path_hits = 0;
+	Uint32 hash_hits = 0;
+	Uint32 decodes = 0;
+	Uint32 evictions = 0;
+};
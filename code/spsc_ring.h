@@ -0,0 +1,88 @@
+#pragma once
+
+//a lock free single producer single consumer ring buffer.
+//only one thread can write, and only one thread can read (it can be the same thread).
+//the capacity is rounded up to a power of 2.
+template<class T>
+class spsc_ring
+{
+public:
+	explicit spsc_ring(size_t min_capacity)
+	{
+		ASSERT(min_capacity > 0);
+		capacity = 1;
+		while(capacity < min_capacity)
+		{
+			capacity <<= 1;
+		}
+		data.reset(new T[capacity]);
+	}
+
+	//producer only, returns the number of elements written (less than count if it's full).
+	size_t write(const T* input, size_t count)
+	{
+		size_t head = write_pos.load(std::memory_order_relaxed);
+		size_t tail = read_pos.load(std::memory_order_acquire);
+		count = std::min(count, capacity - (head - tail));
+
+		//it could wrap around the end.
+		size_t offset = head & (capacity - 1);
+		size_t first = std::min(count, capacity - offset);
+		std::copy(input, input + first, data.get() + offset);
+		std::copy(input + first, input + count, data.get());
+
+		write_pos.store(head + count, std::memory_order_release);
+		return count;
+	}
+
+	//consumer only, returns the number of elements read.
+	size_t read(T* output, size_t count)
+	{
+		size_t tail = read_pos.load(std::memory_order_relaxed);
+		size_t head = write_pos.load(std::memory_order_acquire);
+		count = std::min(count, head - tail);
+
+		size_t offset = tail & (capacity - 1);
+		size_t first = std::min(count, capacity - offset);
+		std::copy(data.get() + offset, data.get() + offset + first, output);
+		std::copy(data.get(), data.get() + (count - first), output + first);
+
+		read_pos.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	bool push(const T& value)
+	{
+		return write(&value, 1) == 1;
+	}
+
+	bool pop(T& value)
+	{
+		return read(&value, 1) == 1;
+	}
+
+	//consumer only, drops everything.
+	void clear()
+	{
+		read_pos.store(write_pos.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+	//only exact if it's called from the producer or consumer while the other thread is idle.
+	size_t size() const
+	{
+		return write_pos.load(std::memory_order_acquire) - read_pos.load(std::memory_order_acquire);
+	}
+
+	size_t get_capacity() const
+	{
+		return capacity;
+	}
+
+private:
+	std::unique_ptr<T[]> data;
+	size_t capacity;
+	//these never wrap around the capacity (only size_t), so full and empty are different.
+	//and they are on different cache lines so the threads don't fight.
+	alignas(64) std::atomic<size_t> write_pos{0};
+	alignas(64) std::atomic<size_t> read_pos{0};
+};
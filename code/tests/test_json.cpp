@@ -1,6 +1,7 @@
 #include "../global.h"
 #include "../SDL_wrapper.h"
 #include "../json_wrapper.h"
+#include "../compressed_rwops.h"
 
 #include <sstream>
 #include <limits.h>
@@ -114,10 +115,7 @@ static bool member_read_and_comp(json_context& json, const member_stored_data& w
 //test members by: insert, compare, write file, read file, compare.
 bool test_json_1()
 {
-    //not a robust file, but just don't write a very large json file.
-    //I could have a deque or stringstream based memory stream in RWops, but it's only useful for testing...
-    char file_memory[9999];
-    Unique_RWops mem_file(Unique_RWops_FromMemory(file_memory, sizeof(file_memory), false, __FUNCTION__));
+    Unique_RWops mem_file(Unique_RWops_CreateMemory(__FUNCTION__));
     if(!mem_file)
     {
         return false;
@@ -154,9 +152,11 @@ bool test_json_1()
             return false;
         }
         
-        //shrink the file to fit (sometimes file->seek(0,SEEK_SET) works, but that is because the rest of the stack memory is filled with zeros.)
-        int file_length = mem_file->tell();
-        mem_file = Unique_RWops_FromMemory(file_memory, file_length, true, __FUNCTION__);
+        //the memory file is exactly the size of what was written.
+        if(mem_file->seek(0, SEEK_SET) != 0)
+        {
+            return false;
+        }
     }
     
 
@@ -173,6 +173,34 @@ bool test_json_1()
         }
     }
 
+    //the memory file has data(), so it was parsed directly,
+    //a stream without data() (like stdio) is parsed through RWops_JsonReadStream.
+    {
+        Unique_RWops packed_file(Unique_RWops_CreateMemory(__FUNCTION__));
+        if(!packed_file || !deflate_chunks(mem_file->data(), mem_file->size(), packed_file.get(), 256) ||
+           packed_file->seek(0, SEEK_SET) != 0)
+        {
+            return false;
+        }
+        Unique_RWops stream_file(Unique_RWops_Inflate(packed_file.get()));
+        if(!stream_file)
+        {
+            return false;
+        }
+        ASSERT(stream_file->data() == NULL);
+
+        json_context json;
+        if(!json.open(stream_file.get()))
+        {
+            return false;
+        }
+
+        if(!member_read_and_comp(json, write))
+        {
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -398,11 +426,7 @@ static bool array_read_and_comp(json_context& json, const array_stored_data& wri
 bool test_json_3()
 {
     const array_stored_data write;
-    //not a robust file, but just don't write a very large json file.
-    //I could have a deque or stringstream based memory stream in RWops, but it's only useful for testing...
-    char file_memory[9999];
-    Unique_RWops mem_file(Unique_RWops_FromMemory(file_memory, sizeof(file_memory), false, __FUNCTION__));
-    std::unique_ptr<char[]> true_memory;
+    Unique_RWops mem_file(Unique_RWops_CreateMemory(__FUNCTION__));
     if(!mem_file)
     {
         return false;
@@ -442,9 +466,11 @@ bool test_json_3()
             return false;
         }
         
-        //shrink the file to fit (sometimes file->seek(0,SEEK_SET) works, but that is because the rest of the stack memory is filled with zeros.)
-        int file_length = mem_file->tell();
-        mem_file = Unique_RWops_FromMemory(file_memory, file_length, true, __FUNCTION__);
+        //the memory file is exactly the size of what was written.
+        if(mem_file->seek(0, SEEK_SET) != 0)
+        {
+            return false;
+        }
     }
     
 
@@ -548,10 +574,7 @@ bool test_json_4()
 //this is also a mess (prints to slog), you can get rid of this, but it is better than nothing.
 bool test_json_5()
 {
-    //not a robust file, but just don't write a very large json file.
-    //I could have a deque or stringstream based memory stream in RWops, but it's only useful for testing...
-    char file_memory[9999];
-    Unique_RWops mem_file(Unique_RWops_FromMemory(file_memory, sizeof(file_memory), false, __FUNCTION__));
+    Unique_RWops mem_file(Unique_RWops_CreateMemory(__FUNCTION__));
     {
         json_context json;
         json.create(mem_file->stream_info);
@@ -593,15 +616,13 @@ bool test_json_5()
             return false;
         }
 
-        //set the null terminator, and print
-        //TODO: this will cause a OOB error in asan if the file is exactly the size of the buffer
-        int pos = mem_file->tell();
-        file_memory[pos] = '\0';
-        slogf("[[[%s\n]]]", file_memory);
+        slogf("[[[%.*s\n]]]", static_cast<int>(mem_file->size()), mem_file->data());
         
-        //shrink the file to fit (sometimes file->seek(0,SEEK_SET) works, but that is because the rest of the stack memory is filled with zeros.)
-        int file_length = mem_file->tell();
-        mem_file = Unique_RWops_FromMemory(file_memory, file_length, true, __FUNCTION__);
+        //the memory file is exactly the size of what was written.
+        if(mem_file->seek(0, SEEK_SET) != 0)
+        {
+            return false;
+        }
     }
     {   //read
         json_context json;
@@ -0,0 +1,272 @@
+#include "../global.h"
+#include "../SDL_wrapper.h"
+#include "../compressed_rwops.h"
+
+#include <string.h>
+
+//fills a growable file past the arena, and reads it back.
+bool test_rwops_1()
+{
+    char arena[64];
+    Unique_RWops mem_file(Unique_RWops_CreateMemory(__FUNCTION__, arena, sizeof(arena)));
+    if(!mem_file)
+    {
+        return false;
+    }
+
+    const int count = 1000;
+    for(int i = 0; i < count; ++i)
+    {
+        if(mem_file->write(&i, sizeof(i), 1) != 1)
+        {
+            serrf("%s: failed to write %d\n", __FUNCTION__, i);
+            return false;
+        }
+    }
+    if(mem_file->size() != count * sizeof(int) || mem_file->tell() != static_cast<long>(count * sizeof(int)))
+    {
+        serrf("%s: expected size: %zu, got: %zu (tell: %ld)\n", __FUNCTION__, count * sizeof(int), mem_file->size(), mem_file->tell());
+        return false;
+    }
+    if(mem_file->data() == arena)
+    {
+        serrf("%s: the file should have moved out of the arena\n", __FUNCTION__);
+        return false;
+    }
+
+    //the view and read() should see the same thing.
+    if(mem_file->seek(0, SEEK_SET) != 0)
+    {
+        return false;
+    }
+    for(int i = 0; i < count; ++i)
+    {
+        int value = -1;
+        int view_value = -1;
+        memcpy(&view_value, mem_file->data() + i * sizeof(int), sizeof(int));
+        if(mem_file->read(&value, sizeof(value), 1) != 1 || value != i || view_value != i)
+        {
+            serrf("%s: expected: %d, got: %d (view: %d)\n", __FUNCTION__, i, value, view_value);
+            return false;
+        }
+    }
+    if(!mem_file->eof())
+    {
+        serrf("%s: expected eof\n", __FUNCTION__);
+        return false;
+    }
+
+    //overwriting in the middle doesn't change the size.
+    int replace = -5;
+    if(mem_file->seek(10 * sizeof(int), SEEK_SET) != 0 || mem_file->write(&replace, sizeof(replace), 1) != 1)
+    {
+        return false;
+    }
+    if(mem_file->size() != count * sizeof(int))
+    {
+        serrf("%s: the size changed: %zu\n", __FUNCTION__, mem_file->size());
+        return false;
+    }
+
+    //seeking out of the file is an error.
+    if(mem_file->seek(1, SEEK_END) == 0)
+    {
+        serrf("%s: seeking past the end should fail\n", __FUNCTION__);
+        return false;
+    }
+    if(!serr_check_error())
+    {
+        serrf("%s: seeking past the end should print an error\n", __FUNCTION__);
+        return false;
+    }
+    serr_get_error();
+    return true;
+}
+
+//a fixed file can't grow, and a readonly file can't be written.
+bool test_rwops_2()
+{
+    char file_memory[10];
+    Unique_RWops mem_file(Unique_RWops_FromMemory(file_memory, sizeof(file_memory), false, __FUNCTION__));
+    if(!mem_file)
+    {
+        return false;
+    }
+
+    const char text[] = "0123456789abcdef";
+    if(mem_file->write(text, 1, 16) != 10)
+    {
+        serrf("%s: expected a partial write\n", __FUNCTION__);
+        return false;
+    }
+    if(!serr_check_error())
+    {
+        serrf("%s: the partial write should print an error\n", __FUNCTION__);
+        return false;
+    }
+    serr_get_error();
+    if(memcmp(file_memory, text, 10) != 0)
+    {
+        serrf("%s: the file doesn't match\n", __FUNCTION__);
+        return false;
+    }
+
+    mem_file = Unique_RWops_FromMemory(file_memory, sizeof(file_memory), true, __FUNCTION__);
+    if(mem_file->write(text, 1, 1) != 0 || !serr_check_error())
+    {
+        serrf("%s: writing to readonly memory should fail\n", __FUNCTION__);
+        return false;
+    }
+    serr_get_error();
+
+    //reading past the end is just eof.
+    char buffer[16];
+    if(mem_file->seek(8, SEEK_SET) != 0 || mem_file->read(buffer, 1, sizeof(buffer)) != 2 || !mem_file->eof())
+    {
+        serrf("%s: expected a short read\n", __FUNCTION__);
+        return false;
+    }
+    if(serr_check_error())
+    {
+        return false;
+    }
+    return true;
+}
+
+//the buffered layer should read the same as the file under it.
+bool test_rwops_3()
+{
+    Unique_RWops mem_file(Unique_RWops_CreateMemory(__FUNCTION__));
+    if(!mem_file)
+    {
+        return false;
+    }
+    const int file_size = 100000;
+    for(int i = 0; i < file_size; ++i)
+    {
+        char c = static_cast<char>(i * 7);
+        if(mem_file->write(&c, 1, 1) != 1)
+        {
+            return false;
+        }
+    }
+    //a second view of the same memory to compare with.
+    Unique_RWops compare_file(Unique_RWops_FromMemory(const_cast<char*>(mem_file->data()), mem_file->size(), true, __FUNCTION__));
+    if(mem_file->seek(0, SEEK_SET) != 0)
+    {
+        return false;
+    }
+    Unique_RWops buffered(Unique_RWops_Buffered(mem_file.get(), false, 1000));
+    if(!buffered)
+    {
+        return false;
+    }
+
+    //a fixed sequence, so a failure can be repeated.
+    Uint32 state = 12345;
+    auto next = [&state](Uint32 range) -> Uint32 {
+        state = state * 1103515245 + 12345;
+        return (state >> 8) % range;
+    };
+    char expected[3000];
+    char got[3000];
+    for(int i = 0; i < 10000; ++i)
+    {
+        if(next(2) == 0)
+        {
+            size_t n = next(sizeof(expected));
+            size_t expected_n = compare_file->read(expected, 1, n);
+            size_t got_n = buffered->read(got, 1, n);
+            if(expected_n != got_n || memcmp(expected, got, got_n) != 0)
+            {
+                serrf("%s: read mismatch at step %d (expected: %zu, got: %zu)\n", __FUNCTION__, i, expected_n, got_n);
+                return false;
+            }
+        }
+        else
+        {
+            long offset = static_cast<long>(next(file_size + 1));
+            if(compare_file->seek(offset, SEEK_SET) != 0 || buffered->seek(offset, SEEK_SET) != 0)
+            {
+                return false;
+            }
+        }
+        if(compare_file->tell() != buffered->tell() || compare_file->eof() != buffered->eof())
+        {
+            serrf("%s: position mismatch at step %d (expected: %ld, got: %ld)\n", __FUNCTION__, i, compare_file->tell(), buffered->tell());
+            return false;
+        }
+    }
+
+    //the borrowed file continues from where the buffer stopped.
+    long position = buffered->tell();
+    buffered.reset();
+    if(mem_file->tell() != position)
+    {
+        serrf("%s: expected the file at: %ld, got: %ld\n", __FUNCTION__, position, mem_file->tell());
+        return false;
+    }
+    return true;
+}
+
+//compresses a file with repeats and noise, then reads it back through seeks.
+bool test_rwops_4()
+{
+    const size_t file_size = 300000;
+    std::vector<char> original(file_size);
+    Uint32 state = 777;
+    for(size_t i = 0; i < file_size; ++i)
+    {
+        state = state * 1103515245 + 12345;
+        //text-like runs, with some noise.
+        original[i] = ((i / 5000) % 2 == 0) ? static_cast<char>("abcabcabd"[i % 9]) : static_cast<char>(state >> 16);
+    }
+
+    Unique_RWops mem_file(Unique_RWops_CreateMemory(__FUNCTION__));
+    if(!mem_file || !deflate_chunks(original.data(), original.size(), mem_file.get(), 4096))
+    {
+        return false;
+    }
+    if(mem_file->size() >= file_size)
+    {
+        serrf("%s: expected compression (size: %zu)\n", __FUNCTION__, mem_file->size());
+        return false;
+    }
+    if(mem_file->seek(0, SEEK_SET) != 0)
+    {
+        return false;
+    }
+    Unique_RWops inflated(Unique_RWops_Inflate(mem_file.get()));
+    if(!inflated)
+    {
+        return false;
+    }
+
+    std::vector<char> result(file_size);
+    if(inflated->read(result.data(), 1, file_size) != file_size || memcmp(result.data(), original.data(), file_size) != 0)
+    {
+        serrf("%s: the file doesn't match\n", __FUNCTION__);
+        return false;
+    }
+    if(!inflated->eof())
+    {
+        serrf("%s: expected eof\n", __FUNCTION__);
+        return false;
+    }
+
+    //seeking lands in the middle of chunks.
+    for(int i = 0; i < 200; ++i)
+    {
+        state = state * 1103515245 + 12345;
+        size_t offset = (state >> 8) % file_size;
+        size_t length = std::min<size_t>((state >> 4) % 10000, file_size - offset);
+        if(inflated->seek(static_cast<long>(offset), SEEK_SET) != 0 ||
+           inflated->read(result.data(), 1, length) != length ||
+           memcmp(result.data(), original.data() + offset, length) != 0)
+        {
+            serrf("%s: mismatch after seeking to %zu (length: %zu)\n", __FUNCTION__, offset, length);
+            return false;
+        }
+    }
+    return serr_check_error() == false;
+}